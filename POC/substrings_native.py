@@ -0,0 +1,55 @@
+from pathlib import Path
+from timeit import default_timer as timer
+
+# the native engine, built with -DSUBSTRINGS_PYTHON=ON
+from _substrings import Engine, MAX_ENT, MIN_ENT
+
+
+class Substrings:
+    """The interface of substrings.Substrings over the native engine.
+
+    Buffers (bytes, bytearray, mmap, numpy arrays) are counted in place, without a copy. Unlike the
+    POC the table is pruned for `amount` keys while counting, so top() can't return more than that,
+    and ties are ordered by key rather than by length.
+    """
+
+    def __init__(self, amount=30):
+        self.amount = amount
+        self.engine = None
+        self.lengths = None
+        self.data = None
+
+    def _engine(self, minl, maxl):
+        if self.lengths != (minl, maxl):
+            self.engine = Engine(minl, maxl, top=self.amount)
+            self.lengths = (minl, maxl)
+        return self.engine
+
+    def process_file(self, path, minl, maxl, ascii=False, scale=0):
+        self._engine(minl, maxl).process_file(str(path), ascii=ascii, scale=scale)
+
+    def process(self, data, minl, maxl, ascii=False, scale=0):
+        self._engine(minl, maxl).process(data, ascii=ascii, scale=scale)
+
+    def top(self, amount):
+        self.data = self.engine.top(min(amount, self.amount))
+        for k, n, _ in self.data:
+            yield k, n
+
+
+def process_all(subs, path, minl, maxl, ascii=False, scale=8):
+    # the engine slices and schedules the file itself, scale is the number of slices per worker
+    subs.process_file(Path(path), minl, maxl, ascii, scale)
+
+
+if __name__ == '__main__':
+    subs = Substrings()
+
+    start = timer()
+    process_all(subs, '<PATH TO FILE>', 15, 30, ascii=False, scale=8)
+    end = timer()
+    ctime = (end - start)
+    print("overall time : ", ctime * 1e3, " ms")
+
+    for k, c in subs.top(30):
+        print(k, c)
@@ -0,0 +1,48 @@
+import random
+
+# the native engine, built with -DSUBSTRINGS_PYTHON=ON; ctest puts it on PYTHONPATH
+from _substrings import Engine
+
+
+def sample(pattern, times, seed=1):
+    # the pattern between random gaps of random bytes, nothing else repeats
+    rng = random.Random(seed)
+    data = bytearray()
+    for _ in range(times):
+        data += rng.randbytes(rng.randrange(40, 80))
+        data += pattern
+    return bytes(data)
+
+
+def test_process():
+    pattern = b"The quick brown fox jumps"
+    engine = Engine(15, 30)
+    engine.process(sample(pattern, 400))
+    found = engine.top()
+    assert found, "nothing found"
+    for key, count, address in found:
+        assert key in pattern, key
+        assert count > 300, (key, count)
+        assert 0 <= address
+    # the amount of a call doesn't stick
+    assert engine.top(3) == found[:3]
+    assert engine.top() == found
+    # buffers are counted in place
+    engine.process(memoryview(bytearray(sample(pattern, 400))))
+    assert engine.top() == found
+
+
+def test_settings():
+    # rejected before anything is built on them
+    for kwargs in ({"skip": 0}, {"minl": 20, "maxl": 10}, {"minl": 6}, {"top": 0}, {"align": 0}, {"min_entropy": 4.0, "max_entropy": 3.0}):
+        try:
+            Engine(**kwargs)
+        except ValueError:
+            continue
+        raise AssertionError(kwargs)
+
+
+if __name__ == '__main__':
+    test_process()
+    test_settings()
+    print("ok")
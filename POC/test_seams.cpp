@@ -0,0 +1,195 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2023 github.com/mrprint
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Counts without dropping (-d 0) the same bytes cut into slices, frames and stream chunks of many
+// sizes, so that windows cross every kind of seam and runs of fill pages straddle the slice ends.
+// Every key found must have its exact count, and wide runs must not depend on the slicing.
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <format>
+#include <cstdint>
+#include <algorithm>
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#include "Substrings.hpp"
+#include "Evaluation.hpp"
+
+using namespace std;
+using namespace substrings;
+
+namespace
+{
+
+    constexpr size_t SAMPLE = size_t(1) << 18;
+    constexpr size_t MINL = 15, MAXL = 30, TOP = 100;
+    // from a couple of slices for the whole input down to slices of a window each
+    constexpr size_t SCALES[] = { 1, 64, 1000, size_t(1) << 30 };
+    constexpr size_t FRAME = 10007;
+
+    ostream quiet(nullptr);
+    int failures = 0;
+
+    // the generated sample with fill runs of a few pages at offsets that are neither page nor word aligned
+    string sample()
+    {
+        string data = synthesize_input(SAMPLE, 7);
+        for (size_t at : { size_t(4093), size_t(70001), size_t(150003) })
+        {
+            for (size_t i = 0; i < FILL_PAGE * 3; ++i)
+                data[at + i] = "\x12\x34\x56\x78"[i % 4];
+        }
+        return data;
+    }
+
+    // the text of the sample as UTF-16LE
+    string widened(string_view data)
+    {
+        string wide;
+        for (char c : data)
+        {
+            wide.push_back((c & 0x80) ? ' ' : c);
+            wide.push_back('\0');
+        }
+        return wide;
+    }
+
+    Result count(const Segments& input, size_t scale, unsigned align, bool filter, bool wide)
+    {
+        SubstringsConcurrent subs(MINL, MAXL, 3, 0, TOP, align);
+        subs.set_log(quiet);
+        subs.process_c(input, false, filter, scale, wide);
+        Result found;
+        for (auto&& i : subs.top_c())
+            found.push_back(move(i));
+        return found;
+    }
+
+    void check(const string& name, const Result& found, const ExactCounts& exact)
+    {
+        if (found.empty()) {
+            cerr << name << ": nothing found" << endl;
+            ++failures;
+        }
+        for (const auto& [key, tally] : found)
+        {
+            if (tally.count != exact.count(key)) {
+                cerr << format("{}: {} counted for a key of {} bytes occurring {} times", name, tally.count, key.length(), exact.count(key)) << endl;
+                ++failures;
+                return;
+            }
+        }
+    }
+
+    void check_all(const string& name, const Segments& input, string_view data, bool compressed)
+    {
+        for (unsigned align : { 1u, 4u, 8u })
+        {
+            const ExactCounts exact(data, MINL, MAXL, align, false);
+            for (bool filter : { false, true })
+            {
+                for (size_t scale : SCALES)
+                {
+                    // a compressed input is cut at its frames or stream chunks, the scale only sets the chunk size
+                    if (compressed && scale == SCALES[0])
+                        continue;
+                    check(format("{} align {} filter {} scale {}", name, align, filter, scale), count(input, scale, align, filter, false), exact);
+                }
+            }
+        }
+    }
+
+    bool same(const Result& l, const Result& r)
+    {
+        return ranges::equal(l, r, [](const ResultEl& a, const ResultEl& b) { return a.first == b.first && a.second.count == b.second.count; });
+    }
+
+    void write_file(const filesystem::path& path, string_view data)
+    {
+        ofstream(path, ios::out | ios::binary).write(data.data(), data.size());
+    }
+
+}
+
+int main()
+{
+    const string data = sample();
+    const auto dir = filesystem::temp_directory_path() / format("substrings-seams-{}", filesystem::hash_value(filesystem::current_path()));
+    filesystem::create_directories(dir);
+
+    Segments memory;
+    memory.assign(data);
+    check_all("memory", memory, data, false);
+
+    Segments file;
+    write_file(dir / "sample.bin", data);
+    file.load((dir / "sample.bin").string());
+    check_all("file", file, data, false);
+
+#if defined(HAVE_ZSTD)
+    // frames of an odd size, so the windows cross the frame ends at every offset
+    string zst;
+    for (size_t at = 0; at < data.size(); at += FRAME)
+    {
+        const auto part = string_view(data).substr(at, FRAME);
+        string frame(ZSTD_compressBound(part.size()), '\0');
+        frame.resize(ZSTD_compress(frame.data(), frame.size(), part.data(), part.size(), 1));
+        zst += frame;
+    }
+    Segments frames;
+    write_file(dir / "sample.zst", zst);
+    frames.load((dir / "sample.zst").string());
+    check_all("zstd frames", frames, data, true);
+#endif
+#if defined(HAVE_ZLIB)
+    // a single gzip member has no frames and is counted as a stream
+    if (auto gz = gzopen((dir / "sample.gz").string().c_str(), "wb")) {
+        gzwrite(gz, data.data(), static_cast<unsigned>(data.size()));
+        gzclose(gz);
+    }
+    Segments stream;
+    stream.load((dir / "sample.gz").string());
+    check_all("gzip stream", stream, data, true);
+#endif
+
+    // no exact reference for wide strings, the slicing must not change what is found
+    const string wide = widened(data);
+    Segments wide_input;
+    wide_input.assign(wide);
+    const Result whole = count(wide_input, SCALES[0], 1, true, true);
+    for (size_t scale : SCALES)
+    {
+        if (!same(count(wide_input, scale, 1, true, true), whole)) {
+            cerr << format("wide scale {}: differs from scale {}", scale, SCALES[0]) << endl;
+            ++failures;
+        }
+    }
+
+    filesystem::remove_all(dir);
+    cout << (failures ? format("{} failures", failures) : "ok") << endl;
+    return failures ? 1 : 0;
+}
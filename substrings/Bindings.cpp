@@ -0,0 +1,160 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <string>
+#include <ostream>
+#include <stdexcept>
+#include <mutex>
+#include <pybind11/pybind11.h>
+#include "Substrings.hpp"
+
+namespace py = pybind11;
+using namespace std;
+using namespace substrings;
+
+// The engine as seen from Python. Inputs come through the buffer protocol and are counted in place,
+// and the GIL is released while a pass runs, so other Python threads go on meanwhile. A call made
+// while another one is still running on the same engine is refused.
+class Engine final
+{
+protected:
+    ostream quiet;
+    SubstringsConcurrent subs;
+    Segments input;
+    size_t default_amount;
+    mutex busy;
+public:
+    Engine(size_t minl, size_t maxl, unsigned skip, unsigned drop, size_t top, unsigned align, size_t memory,
+        float min_entropy, float max_entropy, bool verbose);
+    void process(const py::buffer& data, bool ascii, bool filter, size_t scale, bool wide);
+    void process_file(const string& path, bool ascii, bool filter, size_t scale, bool wide, bool raw, const string& perm);
+    py::list top(size_t amount, bool consume);
+protected:
+    // the limits of handle_args, checked before the counter is built on them
+    static size_t checked(size_t minl, size_t maxl, unsigned skip, size_t top, unsigned align, float min_entropy, float max_entropy);
+    unique_lock<mutex> exclusive();
+};
+
+size_t Engine::checked(size_t minl, size_t maxl, unsigned skip, size_t top, unsigned align, float min_entropy, float max_entropy)
+{
+    if (top < 1 || minl < 7 || maxl < minl || skip < 1 || align < 1 || maxl / align * align < minl
+        || min_entropy < 0.0f || min_entropy >= max_entropy)
+        throw invalid_argument("Invalid engine settings"); // ValueError in Python
+    return minl;
+}
+
+unique_lock<mutex> Engine::exclusive()
+{
+    unique_lock lock(busy, try_to_lock);
+    if (!lock)
+        throw runtime_error("The engine is busy with another call"); // RuntimeError in Python
+    return lock;
+}
+
+Engine::Engine(size_t minl, size_t maxl, unsigned skip, unsigned drop, size_t top, unsigned align, size_t memory,
+    float min_entropy, float max_entropy, bool verbose) :
+    quiet(nullptr), subs(checked(minl, maxl, skip, top, align, min_entropy, max_entropy), maxl, skip, drop, top, align, memory << 20),
+    default_amount(top)
+{
+    subs.set_entropy(min_entropy, max_entropy);
+    subs.keep_offsets(true); // top() gives an address for every key
+    if (!verbose)
+        subs.set_log(quiet);
+}
+
+void Engine::process(const py::buffer& data, bool ascii, bool filter, size_t scale, bool wide)
+{
+    const auto lock = exclusive();
+    // the view keeps the exporter from resizing or freeing the buffer until the pass is over
+    const py::buffer_info info = data.request();
+    py::ssize_t dense = info.itemsize;
+    for (auto i = info.ndim; i-- > 0;)
+    {
+        if (info.shape[i] > 1 && info.strides[i] != dense)
+            throw invalid_argument("The buffer must be C-contiguous");
+        dense *= info.shape[i];
+    }
+    input.assign(DataView(static_cast<const char*>(info.ptr), static_cast<size_t>(info.size * info.itemsize)));
+    py::gil_scoped_release release;
+    subs.reset();
+    subs.process_c(input, ascii, filter, scale, wide);
+}
+
+void Engine::process_file(const string& path, bool ascii, bool filter, size_t scale, bool wide, bool raw, const string& perm)
+{
+    if (!Segments::valid_mask(perm))
+        throw invalid_argument("Invalid permission mask");
+    const auto lock = exclusive();
+    py::gil_scoped_release release;
+    input.load(path, raw);
+    input.filter(perm);
+    subs.reset();
+    subs.process_c(input, ascii, filter, scale, wide);
+}
+
+py::list Engine::top(size_t amount, bool consume)
+{
+    // (key, count, address) tuples, the address is the file offset for anything but a dump;
+    // the amount holds for this call only, the next passes keep pruning for the engine's own
+    const auto lock = exclusive();
+    subs.set_amount(amount ? amount : default_amount);
+    Result found;
+    try
+    {
+        py::gil_scoped_release release;
+        for (auto&& i : subs.top_c(false, consume))
+            found.push_back(move(i));
+    }
+    catch (...)
+    {
+        subs.set_amount(default_amount);
+        throw;
+    }
+    subs.set_amount(default_amount);
+    py::list result;
+    for (const auto& [key, tally] : found)
+        result.append(py::make_tuple(py::bytes(key), tally.count, input.address(tally.offset)));
+    return result;
+}
+
+PYBIND11_MODULE(_substrings, m)
+{
+    m.doc() = "Native engine of substrings: the most frequent byte sequences of large inputs";
+    m.attr("MIN_ENT") = MIN_ENT;
+    m.attr("MAX_ENT") = MAX_ENT;
+    py::class_<Engine>(m, "Engine")
+        .def(py::init<size_t, size_t, unsigned, unsigned, size_t, unsigned, size_t, float, float, bool>(),
+            py::arg("minl") = 15, py::arg("maxl") = 30, py::arg("skip") = 3, py::arg("drop") = 1, py::arg("top") = 30,
+            py::arg("align") = 1, py::arg("memory") = 0, py::arg("min_entropy") = MIN_ENT, py::arg("max_entropy") = MAX_ENT,
+            py::arg("verbose") = false,
+            "Lengths minl..maxl probed every skip bytes, memory is the budget in MiB, 0 takes the whole limit")
+        .def("process", &Engine::process,
+            py::arg("data"), py::arg("ascii") = false, py::arg("filter") = true, py::arg("scale") = 0, py::arg("wide") = false,
+            "Counts a contiguous buffer (bytes, bytearray, mmap, numpy array...) without copying it")
+        .def("process_file", &Engine::process_file,
+            py::arg("path"), py::arg("ascii") = false, py::arg("filter") = true, py::arg("scale") = 0, py::arg("wide") = false,
+            py::arg("raw") = false, py::arg("perm") = "...",
+            "Counts a file, the segments of ELF cores and minidumps unless raw")
+        .def("top", &Engine::top, py::arg("amount") = 0, py::arg("consume") = false,
+            "The most frequent keys as (key, count, address), consume frees the table but allows no further top");
+}
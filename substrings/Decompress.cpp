@@ -0,0 +1,381 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(HAVE_LZ4)
+#include <lz4frame.h>
+#endif
+
+#include <filesystem>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include "Decompress.hpp"
+
+using namespace std;
+
+constexpr uint32_t ZSTD_FRAME_MAGIC = 0xfd2fb528;
+constexpr uint32_t ZSTD_SKIPPABLE_MAGIC = 0x184d2a50; // the low four bits are free
+constexpr uint32_t LZ4_FRAME_MAGIC = 0x184d2204;
+constexpr uint16_t GZIP_MAGIC = 0x8b1f;
+constexpr size_t READ_SIZE = 1u << 20;
+
+template<typename T>
+static T get(const char* data)
+{
+    T v;
+    memcpy(&v, data, sizeof(T));
+    return v;
+}
+
+Codec detect_codec(const string& head)
+{
+    if (head.size() >= 4 && get<uint32_t>(head.data()) == ZSTD_FRAME_MAGIC)
+        return Codec::Zstd;
+    if (head.size() >= 8 && (get<uint32_t>(head.data()) & ~0xfu) == ZSTD_SKIPPABLE_MAGIC) {
+        // lz4 takes the same skippable frames, the frame behind one tells them apart if the head holds it
+        const size_t next = 8 + size_t(get<uint32_t>(head.data() + 4));
+        if (next < head.size() && head.size() - next >= 4 && get<uint32_t>(head.data() + next) == LZ4_FRAME_MAGIC)
+            return Codec::Lz4;
+        return Codec::Zstd;
+    }
+    if (head.size() >= 4 && get<uint32_t>(head.data()) == LZ4_FRAME_MAGIC)
+        return Codec::Lz4;
+    if (head.size() >= 3 && get<uint16_t>(head.data()) == GZIP_MAGIC && head[2] == 8) // deflate
+        return Codec::Gzip;
+    return Codec::None;
+}
+
+const char* codec_name(Codec codec)
+{
+    switch (codec) {
+    case Codec::Zstd: return "zstd";
+    case Codec::Gzip: return "gzip";
+    case Codec::Lz4: return "lz4";
+    default: return "none";
+    }
+}
+
+bool codec_available(Codec codec)
+{
+    switch (codec) {
+#if defined(HAVE_ZSTD)
+    case Codec::Zstd: return true;
+#endif
+#if defined(HAVE_ZLIB)
+    case Codec::Gzip: return true;
+#endif
+#if defined(HAVE_LZ4)
+    case Codec::Lz4: return true;
+#endif
+    case Codec::None: return true;
+    default: return false;
+    }
+}
+
+vector<Frame> zstd_frames(const string& path)
+{
+    // Walks the frame and block headers, the blocks themselves are skipped. The content size is
+    // optional in the format, without it the frames can't be placed in the stream up front.
+    static constexpr size_t dict_bytes[] = { 0, 1, 2, 4 }, size_bytes[] = { 0, 2, 4, 8 };
+    ifstream f(path, ios::in | ios::binary);
+    const size_t fsize = filesystem::file_size(path);
+    vector<Frame> frames;
+    size_t at = 0, content = 0;
+    char head[18];
+    auto read_at = [&](size_t offset, size_t length)
+    {
+        f.clear();
+        f.seekg(static_cast<streamoff>(offset));
+        f.read(head, static_cast<streamsize>(length));
+        return static_cast<size_t>(f.gcount()) == length;
+    };
+    while (at < fsize)
+    {
+        if (!read_at(at, 8))
+            return {};
+        const auto magic = get<uint32_t>(head);
+        if ((magic & ~0xfu) == ZSTD_SKIPPABLE_MAGIC) {
+            at += 8 + get<uint32_t>(head + 4);
+            continue;
+        }
+        const auto descriptor = static_cast<uint8_t>(head[4]);
+        const bool single = descriptor & 0x20, checksum = descriptor & 0x04;
+        const size_t fcs = (descriptor >> 6) ? size_bytes[descriptor >> 6] : single;
+        const size_t fcs_at = 5 + !single + dict_bytes[descriptor & 3];
+        if (magic != ZSTD_FRAME_MAGIC || !fcs || !read_at(at, fcs_at + fcs))
+            return {};
+        uint64_t size = 0;
+        memcpy(&size, head + fcs_at, fcs); // little-endian
+        if (fcs == 2)
+            size += 256;
+        size_t block = at + fcs_at + fcs;
+        for (bool last = false; !last;)
+        {
+            if (!read_at(block, 3))
+                return {};
+            const uint32_t header = static_cast<uint8_t>(head[0]) | static_cast<uint8_t>(head[1]) << 8 | static_cast<uint8_t>(head[2]) << 16;
+            const unsigned type = (header >> 1) & 3;
+            if (type == 3)
+                return {};
+            last = header & 1;
+            block += 3 + ((type == 1) ? 1 : header >> 3); // an RLE block stores one byte
+        }
+        const size_t end = block + (checksum ? 4 : 0);
+        if (end > fsize)
+            return {};
+        frames.push_back({ at, end - at, content, static_cast<size_t>(size) });
+        content += static_cast<size_t>(size);
+        at = end;
+    }
+    return frames;
+}
+
+Decompressor::Decompressor(const string& path, size_t offset) :
+    file(path, ios::in | ios::binary), input(READ_SIZE), pos(0), end(0), consumed(offset)
+{
+    if (!file)
+        throw runtime_error(format("Cannot open {}", path));
+    file.seekg(static_cast<streamoff>(offset));
+}
+
+Decompressor::~Decompressor() {}
+
+bool Decompressor::refill()
+{
+    file.read(input.data(), static_cast<streamsize>(input.size()));
+    pos = 0;
+    end = static_cast<size_t>(max<streamsize>(file.gcount(), 0));
+    consumed += end;
+    return end > 0;
+}
+
+#if defined(HAVE_ZSTD)
+class ZstdReader final : public Decompressor
+{
+protected:
+    ZSTD_DCtx* ctx;
+    size_t pending;
+public:
+    ZstdReader(const string& path, size_t offset) : Decompressor(path, offset), ctx(ZSTD_createDCtx()), pending(0)
+    {
+        if (!ctx)
+            throw bad_alloc();
+    }
+    ~ZstdReader() override { ZSTD_freeDCtx(ctx); }
+    size_t read(char* out, size_t n) override
+    {
+        ZSTD_outBuffer ob{ out, n, 0 };
+        while (ob.pos < ob.size)
+        {
+            const bool more = pos < end || refill();
+            ZSTD_inBuffer ib{ input.data() + pos, end - pos, 0 };
+            const size_t before = ob.pos;
+            const size_t hint = ZSTD_decompressStream(ctx, &ob, &ib);
+            if (ZSTD_isError(hint))
+                throw runtime_error(format("Corrupt zstd stream: {}", ZSTD_getErrorName(hint)));
+            pos += ib.pos;
+            if (ib.pos || ob.pos != before)
+                pending = hint; // zero right at the end of a frame
+            else if (!more) {
+                if (pending)
+                    throw runtime_error("Truncated zstd stream");
+                break;
+            }
+        }
+        return ob.pos;
+    }
+};
+#endif
+
+#if defined(HAVE_ZLIB)
+class GzipReader final : public Decompressor
+{
+protected:
+    z_stream zs;
+    bool member;
+public:
+    GzipReader(const string& path, size_t offset) : Decompressor(path, offset), zs{}, member(false)
+    {
+        if (inflateInit2(&zs, 15 + 16) != Z_OK)
+            throw bad_alloc();
+    }
+    ~GzipReader() override { inflateEnd(&zs); }
+    size_t read(char* out, size_t n) override
+    {
+        zs.next_out = reinterpret_cast<Bytef*>(out);
+        zs.avail_out = static_cast<uInt>(n);
+        while (zs.avail_out)
+        {
+            const bool more = pos < end || refill();
+            zs.next_in = reinterpret_cast<Bytef*>(input.data() + pos);
+            zs.avail_in = static_cast<uInt>(end - pos);
+            const uInt before = zs.avail_out, available = zs.avail_in;
+            const int ret = inflate(&zs, Z_NO_FLUSH);
+            pos = end - zs.avail_in;
+            member |= zs.avail_in != available;
+            if (ret == Z_STREAM_END) {
+                // concatenated members make up one stream
+                inflateReset(&zs);
+                member = false;
+                continue;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR)
+                throw runtime_error(format("Corrupt gzip stream: {}", zs.msg ? zs.msg : "bad data"));
+            if (!more && zs.avail_out == before) {
+                if (member)
+                    throw runtime_error("Truncated gzip stream");
+                break;
+            }
+        }
+        return n - zs.avail_out;
+    }
+};
+#endif
+
+#if defined(HAVE_LZ4)
+class Lz4Reader final : public Decompressor
+{
+protected:
+    LZ4F_dctx* ctx;
+    size_t pending;
+public:
+    Lz4Reader(const string& path, size_t offset) : Decompressor(path, offset), ctx(nullptr), pending(0)
+    {
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)))
+            throw bad_alloc();
+    }
+    ~Lz4Reader() override { LZ4F_freeDecompressionContext(ctx); }
+    size_t read(char* out, size_t n) override
+    {
+        size_t done = 0;
+        while (done < n)
+        {
+            const bool more = pos < end || refill();
+            size_t src = end - pos, dst = n - done;
+            const size_t hint = LZ4F_decompress(ctx, out + done, &dst, input.data() + pos, &src, nullptr);
+            if (LZ4F_isError(hint))
+                throw runtime_error(format("Corrupt lz4 stream: {}", LZ4F_getErrorName(hint)));
+            pos += src;
+            done += dst;
+            if (src || dst)
+                pending = hint; // zero right at the end of a frame
+            else if (!more) {
+                if (pending)
+                    throw runtime_error("Truncated lz4 stream");
+                break;
+            }
+        }
+        return done;
+    }
+};
+#endif
+
+unique_ptr<Decompressor> Decompressor::open(const string& path, Codec codec, [[maybe_unused]] size_t offset)
+{
+    switch (codec) {
+#if defined(HAVE_ZSTD)
+    case Codec::Zstd: return make_unique<ZstdReader>(path, offset);
+#endif
+#if defined(HAVE_ZLIB)
+    case Codec::Gzip: return make_unique<GzipReader>(path, offset);
+#endif
+#if defined(HAVE_LZ4)
+    case Codec::Lz4: return make_unique<Lz4Reader>(path, offset);
+#endif
+    default:
+        throw runtime_error(format("{} is {} compressed, which this build can't read", path, codec_name(codec)));
+    }
+}
+
+ChunkQueue::ChunkQueue(size_t count) : closed(false), failed(false)
+{
+    for (size_t i = count; i-- > 0;)
+        spare.push_back(i);
+}
+
+ChunkQueue::~ChunkQueue() {}
+
+size_t ChunkQueue::acquire()
+{
+    unique_lock lock(mtx);
+    changed.wait(lock, [this] { return failed || !spare.empty(); });
+    if (failed)
+        return NONE;
+    const size_t index = spare.back();
+    spare.pop_back();
+    return index;
+}
+
+void ChunkQueue::post(size_t index)
+{
+    {
+        scoped_lock lock(mtx);
+        posted.push_back(index);
+    }
+    changed.notify_all();
+}
+
+size_t ChunkQueue::take()
+{
+    unique_lock lock(mtx);
+    changed.wait(lock, [this] { return closed || !posted.empty(); });
+    if (posted.empty())
+        return NONE;
+    const size_t index = posted.front();
+    posted.pop_front();
+    return index;
+}
+
+void ChunkQueue::release(size_t index)
+{
+    {
+        scoped_lock lock(mtx);
+        spare.push_back(index);
+    }
+    changed.notify_all();
+}
+
+void ChunkQueue::close()
+{
+    {
+        scoped_lock lock(mtx);
+        closed = true;
+    }
+    changed.notify_all();
+}
+
+void ChunkQueue::fail()
+{
+    {
+        scoped_lock lock(mtx);
+        failed = true;
+    }
+    changed.notify_all();
+}
@@ -0,0 +1,102 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <cstddef>
+#include <condition_variable>
+
+enum class Codec {
+    None,
+    Zstd,
+    Gzip,
+    Lz4
+};
+
+// A zstd frame: where it lies in the file and where its content lies in the decompressed stream
+struct Frame
+{
+    std::size_t offset, length;
+    std::size_t content, size;
+};
+
+// format of a file by the magic number at its head
+Codec detect_codec(const std::string& head);
+const char* codec_name(Codec codec);
+// whether support of the format was built in, HAVE_ZSTD, HAVE_ZLIB and HAVE_LZ4 enable them
+bool codec_available(Codec codec);
+// The frames of a zstd file from their headers alone, empty unless every frame states its content size.
+// Skippable frames are left out.
+std::vector<Frame> zstd_frames(const std::string& path);
+
+// The decompressed stream of a file, read from a frame boundary of the compressed file on
+class Decompressor
+{
+protected:
+    std::ifstream file;
+    std::vector<char> input;
+    std::size_t pos, end, consumed;
+    Decompressor(const std::string& path, std::size_t offset);
+    // false at the end of the file
+    bool refill();
+public:
+    static std::unique_ptr<Decompressor> open(const std::string& path, Codec codec, std::size_t offset = 0);
+    virtual ~Decompressor();
+    // fills out with n bytes, fewer only at the end of the stream
+    virtual std::size_t read(char* out, std::size_t n) = 0;
+    // compressed bytes used so far
+    std::size_t position() const { return consumed - (end - pos); }
+};
+
+// Passes a fixed set of buffers between one producer and the workers: the producer takes a spare one,
+// fills and posts it, the workers take the posted ones in order and release them when done. The producer
+// waits while all of them are in flight, which bounds the memory of a stream to the set.
+class ChunkQueue final
+{
+protected:
+    std::mutex mtx;
+    std::condition_variable changed;
+    std::vector<std::size_t> spare;
+    std::deque<std::size_t> posted;
+    bool closed, failed;
+public:
+    static constexpr std::size_t NONE = ~std::size_t(0);
+    explicit ChunkQueue(std::size_t count);
+    ~ChunkQueue();
+    // a spare buffer, NONE once a worker has failed
+    std::size_t acquire();
+    void post(std::size_t index);
+    // the next posted buffer, NONE when the queue is closed and drained
+    std::size_t take();
+    void release(std::size_t index);
+    // the producer is done
+    void close();
+    // a worker is done for good, the producer stops at its next acquire
+    void fail();
+};
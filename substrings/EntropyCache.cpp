@@ -25,9 +25,6 @@
 #include "EntropyCache.hpp"
 
 using namespace std;
-using namespace substrings;
-
-constexpr auto RESTORE_PER = 1000;
 
 myfastmath::Log2<float> fastlog2;
 
@@ -42,54 +39,14 @@ EntropyCache::EntropyCache() :
 
 EntropyCache::~EntropyCache() {}
 
-float EntropyCache::estimate(DataView data, size_t start, unsigned length)
+void EntropyCache::restart()
 {
-    bool need_save = counter % RESTORE_PER == 0;
-    if (start - cstart == 1 && length == clength && !need_save) [[unlikely]] {
-        ++counter;
-        {
-            auto& tfrq = freqs[chr];
-            if (tfrq.freq > 0) [[unlikely]] {
-                entropy += tfrq.entropy;
-                tfrq.freq--;
-                if (tfrq.freq > 0) [[likely]] {
-                    float te = calculate(tfrq.freq, clength);
-                    tfrq.entropy = te;
-                    entropy -= te;
-                }
-                else [[unlikely]] {
-                    tfrq.entropy = 0.0;
-                }
-            }
-        }
-        {
-            auto& tfrq = freqs[static_cast<uint8_t>(data.back())];
-            if (tfrq.freq > 0) [[unlikely]] {
-                entropy += tfrq.entropy;
-            }
-            tfrq.freq++;
-            float te = calculate(tfrq.freq, clength);
-            tfrq.entropy = te;
-            entropy -= te;
-        }
-        chr = data[0];
-        cstart++;
-    }
-    else [[likely]] {
-        if (start > cstart || cstart == numeric_limits<size_t>::max()) {
-            ++counter;
-            entropy = shannon_entropy_save(data);
-            cstart = start;
-            clength = length;
-        }
-        else {
-            return shannon_entropy(data);
-        }
-    }
-    return entropy;
+    cstart = numeric_limits<size_t>::max();
+    clength = numeric_limits<size_t>::max();
+    counter = 0;
 }
 
-float EntropyCache::shannon_entropy(DataView data)
+float EntropyCache::shannon_entropy(string_view data)
 {
     float ent = 0.0;
     array<unsigned, 256> lfreqs{};
@@ -107,7 +64,7 @@ float EntropyCache::shannon_entropy(DataView data)
     return ent;
 }
 
-float EntropyCache::shannon_entropy_save(DataView data)
+float EntropyCache::shannon_entropy_save(string_view data)
 {
     float ent = 0.0;
     freqs = {};
@@ -24,7 +24,8 @@
 
 #include <array>
 #include <cmath>
-#include "Substrings.hpp"
+#include <limits>
+#include <string_view>
 #include "FastLog2.hpp"
 
 extern myfastmath::Log2<float> fastlog2;
@@ -44,15 +45,66 @@ protected:
     size_t counter;
     uint8_t chr;
 public:
+    static constexpr std::size_t RESTORE_PER = 1000;
+
     EntropyCache();
     ~EntropyCache();
-    float estimate(substrings::DataView data, std::size_t start, unsigned length);
+    // the length is an unsigned or, for a window width fixed at compile time, an integral_constant of one
+    float estimate(std::string_view data, std::size_t start, auto length);
+    // forget the window, the next estimate counts from scratch
+    void restart();
 protected:
-    float shannon_entropy(substrings::DataView data);
-    float shannon_entropy_save(substrings::DataView data);
+    float shannon_entropy(std::string_view data);
+    float shannon_entropy_save(std::string_view data);
     float calculate(std::size_t freq, auto length) {
         float frq = freq / static_cast<float>(length);
         return frq * fastlog2.log2(frq); // std::log(frq) / std::log(2.0) // std::log2 is too slow
     }
 };
 
+float EntropyCache::estimate(std::string_view data, std::size_t start, auto length)
+{
+    bool need_save = counter % RESTORE_PER == 0;
+    if (start - cstart == 1 && length == clength && !need_save) [[unlikely]] {
+        ++counter;
+        {
+            auto& tfrq = freqs[chr];
+            if (tfrq.freq > 0) [[unlikely]] {
+                entropy += tfrq.entropy;
+                tfrq.freq--;
+                if (tfrq.freq > 0) [[likely]] {
+                    float te = calculate(tfrq.freq, length);
+                    tfrq.entropy = te;
+                    entropy -= te;
+                }
+                else [[unlikely]] {
+                    tfrq.entropy = 0.0;
+                }
+            }
+        }
+        {
+            auto& tfrq = freqs[static_cast<uint8_t>(data.back())];
+            if (tfrq.freq > 0) [[unlikely]] {
+                entropy += tfrq.entropy;
+            }
+            tfrq.freq++;
+            float te = calculate(tfrq.freq, length);
+            tfrq.entropy = te;
+            entropy -= te;
+        }
+        chr = data[0];
+        cstart++;
+    }
+    else [[likely]] {
+        if (start > cstart || cstart == std::numeric_limits<std::size_t>::max()) {
+            ++counter;
+            entropy = shannon_entropy_save(data);
+            cstart = start;
+            clength = length;
+        }
+        else {
+            return shannon_entropy(data);
+        }
+    }
+    return entropy;
+}
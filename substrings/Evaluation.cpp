@@ -0,0 +1,257 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <algorithm>
+#include <ranges>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "Evaluation.hpp"
+#include "cli.hpp"
+
+using namespace std;
+using namespace substrings;
+
+ExactCounts::ExactCounts(string_view data, size_t minl, size_t maxl, unsigned align, bool ascii) :
+    data(data), maxl(maxl), ascii(ascii)
+{
+    if (data.length() > numeric_limits<uint32_t>::max())
+        throw runtime_error("The exact reference is limited to 4 GiB");
+    align = max(align, 1u);
+    for (size_t length = minl; length <= maxl; ++length)
+    {
+        if (length % align == 0)
+            lengths.push_back(length);
+    }
+    const size_t limit = (data.length() > maxl) ? data.length() - maxl : 0;
+    for (size_t start = 0; start < limit; start += align)
+        starts.push_back(static_cast<uint32_t>(start));
+    auto head = [&](uint32_t start) { return data.substr(start, maxl); };
+    sort(starts.begin(), starts.end(),
+        [&](uint32_t l, uint32_t r)
+        {
+            const auto order = head(l).compare(head(r));
+            return order ? order < 0 : l < r;
+        });
+    common.resize(starts.size());
+    for (size_t i = 1; i < starts.size(); ++i)
+    {
+        const auto prev = head(starts[i - 1]), next = head(starts[i]);
+        common[i] = static_cast<uint32_t>(ranges::mismatch(prev, next).in1 - prev.begin());
+    }
+}
+
+ExactCounts::~ExactCounts() {}
+
+size_t ExactCounts::count(string_view key) const
+{
+    if (key.length() > maxl)
+        return 0;
+    const auto found = ranges::equal_range(starts, key, ranges::less{}, [&](uint32_t start) { return data.substr(start, key.length()); });
+    return found.size();
+}
+
+Result ExactCounts::top(size_t reserve) const
+{
+    // keeps the best runs in a buffer cut back with nth_element whenever it doubles, as select() does
+    struct Run
+    {
+        size_t count;
+        uint32_t start, length;
+    };
+    auto key = [&](const Run& run) { return data.substr(run.start, run.length); };
+    auto better = [&](const Run& l, const Run& r) { return (l.count == r.count) ? key(l) > key(r) : l.count > r.count; };
+    Result result;
+    if (!reserve)
+        return result;
+    vector<Run> best;
+    size_t floor = 0;
+    auto offer = [&](const Run& run)
+    {
+        if (run.count < floor || (ascii && ranges::any_of(key(run), [](char c) { return (c & 0x80) != 0; })))
+            return;
+        best.push_back(run);
+        if (best.size() >= reserve * 2) {
+            nth_element(best.begin(), best.begin() + reserve, best.end(), better);
+            floor = best[reserve].count;
+            best.resize(reserve);
+        }
+    };
+    for (size_t length : lengths)
+    {
+        size_t begin = 0;
+        for (size_t i = 1; i <= starts.size(); ++i)
+        {
+            if (i == starts.size() || common[i] < length) {
+                offer({ i - begin, starts[begin], static_cast<uint32_t>(length) });
+                begin = i;
+            }
+        }
+    }
+    const size_t count = min(best.size(), reserve);
+    partial_sort(best.begin(), best.begin() + count, best.end(), better);
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        result.emplace_back(Data(key(best[i])), Tally(best[i].count, best[i].start));
+    return result;
+}
+
+string synthesize_input(size_t bytes, uint64_t seed)
+{
+    constexpr size_t TOKENS = 4096;
+    constexpr string_view LETTERS = "etaoinshrdlu    ";
+    mt19937_64 rng(seed);
+    auto uniform = [&](size_t lo, size_t hi) { return uniform_int_distribution<size_t>(lo, hi)(rng); };
+    vector<string> tokens(TOKENS);
+    vector<double> weights(TOKENS);
+    for (size_t i = 0; i < TOKENS; ++i)
+    {
+        tokens[i].resize(uniform(8, 96));
+        for (auto& c : tokens[i])
+            c = (i % 2) ? static_cast<char>(uniform(0, 255)) : LETTERS[uniform(0, LETTERS.length() - 1)];
+        weights[i] = 1.0 / static_cast<double>(i + 1);
+    }
+    discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    string out;
+    while (out.length() < bytes)
+    {
+        const auto kind = uniform(0, 99);
+        if (kind < 70)
+            out += tokens[pick(rng)];
+        else if (kind < 99) {
+            for (auto n = uniform(1, 64); n > 0; --n)
+                out.push_back(static_cast<char>(uniform(0, 255)));
+        }
+        else {
+            const auto pattern = static_cast<uint32_t>(uniform(0, numeric_limits<uint32_t>::max()));
+            for (auto n = uniform(8, 128); n > 0; --n)
+                out.append(reinterpret_cast<const char*>(&pattern), sizeof(pattern));
+        }
+    }
+    out.resize(bytes);
+    return out;
+}
+
+static void run_grid(const Settings& settings, string_view sample)
+{
+    struct Setting
+    {
+        unsigned drop, skip;
+        int64_t scale;
+        bool filter;
+        float lo, hi;
+    };
+    auto axis = []<typename T>(initializer_list<T> values)
+    {
+        vector<T> v(values);
+        ranges::sort(v);
+        v.erase(ranges::unique(v).begin(), v.end());
+        return v;
+    };
+    auto seconds_since = [](auto start) { return chrono::duration<double>(chrono::steady_clock::now() - start).count(); };
+    auto mib_per_s = [&](double seconds) { return static_cast<double>(sample.size()) / max(seconds, 1e-9) / (1 << 20); };
+
+    auto start = chrono::steady_clock::now();
+    ExactCounts exact(sample, settings.lmin, settings.lmax, settings.alignment, settings.ascii);
+    SubstringsConcurrent ranker(settings.lmin, settings.lmax, 1, 0, settings.top, settings.alignment);
+    // as many candidates as top_c ranks without skipping
+    const Result expected = ranker.filter_close(exact.top(settings.top * settings.lmax * exact.length_count()));
+    cerr << "Exact reference: " << sample.size() << " bytes, " << expected.size() << " keys in the top, "
+        << fixed << setprecision(1) << seconds_since(start) << " s" << endl;
+
+    Segments input;
+    input.assign(sample); // counted in place, so the throughput is the one of the counting alone
+    vector<pair<float, float>> bounds{ { MIN_ENT, MAX_ENT }, { FILL_ENT, 4.0f } };
+    if (ranges::find(bounds, pair(settings.min_entropy, settings.max_entropy)) == bounds.end())
+        bounds.emplace_back(settings.min_entropy, settings.max_entropy);
+    vector<Setting> grid;
+    for (unsigned d : axis({ 0u, 1u, 4u, settings.drop }))
+    {
+        for (unsigned k : (settings.alignment > 1) ? vector{ settings.skip } : axis({ 1u, settings.skip }))
+        {
+            for (int64_t s : axis({ int64_t(1), settings.scale, int64_t(64) }))
+            {
+                grid.push_back({ d, k, s, false, 0.0f, 0.0f });
+                for (auto [lo, hi] : bounds)
+                    grid.push_back({ d, k, s, true, lo, hi });
+            }
+        }
+    }
+
+    cout << "drop \tskip \tscale \tentropy \trecall \tprecision \terror \tMiB/s\n";
+    for (const auto& setting : grid)
+    {
+        SubstringsConcurrent subs(settings.lmin, settings.lmax, setting.skip, setting.drop, settings.top, settings.alignment, settings.max_memory);
+        subs.set_entropy(setting.lo, setting.hi);
+        start = chrono::steady_clock::now();
+        subs.process_c(input, settings.ascii, setting.filter, static_cast<size_t>(setting.scale), false);
+        Result found;
+        for (auto&& i : subs.top_c(false, true))
+            found.push_back(move(i));
+        const double seconds = seconds_since(start);
+
+        size_t hits = 0;
+        double error = 0.0;
+        for (const auto& [key, tally] : found)
+        {
+            if (ranges::find(expected, key, &ResultEl::first) != expected.end())
+                ++hits;
+            const auto count = static_cast<double>(exact.count(key));
+            error += (count > 0.0) ? abs(static_cast<double>(tally.count) - count) / count : 1.0;
+        }
+        cout << setting.drop << " \t" << setting.skip << " \t" << setting.scale << " \t" << fixed << setprecision(1);
+        if (setting.filter)
+            cout << setting.lo << '-' << setting.hi;
+        else
+            cout << "off";
+        cout << " \t" << setprecision(3)
+            << (expected.empty() ? 1.0 : static_cast<double>(hits) / expected.size()) << " \t"
+            << (found.empty() ? 1.0 : static_cast<double>(hits) / found.size()) << " \t"
+            << (found.empty() ? 0.0 : error / found.size()) << " \t"
+            << setprecision(1) << mib_per_s(seconds) << '\n';
+        cout.flush();
+    }
+}
+
+void evaluate(const Settings& settings, size_t bytes)
+{
+    if (settings.wide) {
+        cerr << "There is no exact reference for wide strings" << endl;
+        return;
+    }
+    string sample;
+    if (settings.input_file.empty())
+        sample = synthesize_input(bytes);
+    else {
+        sample.resize(min<size_t>(filesystem::file_size(settings.input_file), bytes));
+        if (!ifstream(settings.input_file, ios::in | ios::binary).read(sample.data(), sample.size()))
+            throw runtime_error("Cannot read " + settings.input_file);
+    }
+    run_grid(settings, sample);
+}
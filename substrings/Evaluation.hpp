@@ -0,0 +1,64 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "Substrings.hpp"
+
+struct Settings;
+
+// Exact counts of every window of the probed lengths, the reference the approximate pipeline is
+// measured against. The window starts are sorted by their first maxl bytes, so all the occurrences
+// of a key are adjacent: a key is counted by a binary search, and the most frequent keys of a length
+// are the longest runs of starts sharing that many bytes.
+class ExactCounts final
+{
+protected:
+    std::string_view data;
+    std::vector<std::size_t> lengths;
+    std::vector<std::uint32_t> starts;
+    // bytes shared with the previous start, at most maxl
+    std::vector<std::uint32_t> common;
+    std::size_t maxl;
+    bool ascii;
+public:
+    // the starts and lengths of process() without skipping, data is limited to 4 GiB
+    ExactCounts(std::string_view data, std::size_t minl, std::size_t maxl, unsigned align, bool ascii);
+    ~ExactCounts();
+    std::size_t count(std::string_view key) const;
+    // the `reserve` most frequent keys in the order of top_c, before the similar ones are dropped
+    substrings::Result top(std::size_t reserve) const;
+    std::size_t length_count() const { return lengths.size(); }
+};
+
+// Generated input: tokens of Zipf distributed frequency, half text and half binary, separated by
+// random noise with occasional fill runs. The same seed gives the same bytes with the same library.
+std::string synthesize_input(std::size_t bytes, std::uint64_t seed = 1);
+
+// Runs a grid of drop, skip, scale and filter settings over the head of the input, or over generated
+// data without one, and prints the top recall, precision, relative count error and throughput of each
+void evaluate(const Settings& settings, std::size_t bytes);
@@ -0,0 +1,175 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#if !defined(_MSC_BUILD) && !defined(__MINGW32__)
+#include <sys/mman.h>
+#define HUGEPAGES_MMAP
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include "HugePages.hpp"
+
+using namespace std;
+
+namespace
+{
+
+    atomic<bool> use_huge = false;
+
+#if defined(HUGEPAGES_MMAP)
+    constexpr size_t ARENA_BYTES = size_t(256) << 20;
+
+    size_t round_up(size_t bytes)
+    {
+        return (bytes + hugepages::HUGE_PAGE - 1) / hugepages::HUGE_PAGE * hugepages::HUGE_PAGE;
+    }
+
+    void* map_aligned(size_t bytes)
+    {
+        // over-map by a page and trim, so the block starts on a huge page boundary
+        const size_t span = bytes + hugepages::HUGE_PAGE;
+        void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            throw bad_alloc();
+        auto base = reinterpret_cast<uintptr_t>(raw);
+        auto start = (base + hugepages::HUGE_PAGE - 1) / hugepages::HUGE_PAGE * hugepages::HUGE_PAGE;
+        if (start > base)
+            munmap(raw, start - base);
+        if (base + span > start + bytes)
+            munmap(reinterpret_cast<void*>(start + bytes), base + span - start - bytes);
+#if defined(MADV_HUGEPAGE)
+        // fails where transparent huge pages are off, the block is then just ordinary pages
+        madvise(reinterpret_cast<void*>(start), bytes, MADV_HUGEPAGE);
+#endif
+        return reinterpret_cast<void*>(start);
+    }
+
+    // Released blocks are kept for the next tables instead of unmapping them, as the workers allocate
+    // tables of about the same sizes chunk after chunk. At most ARENA_BYTES are kept for all threads
+    // together, and release() unmaps them once a pass is over.
+    class Arena final
+    {
+    protected:
+        mutex mtx;
+        vector<pair<void*, size_t>> spare;
+        size_t kept = 0;
+    public:
+        void* take(size_t bytes)
+        {
+            {
+                scoped_lock lock(mtx);
+                for (auto it = spare.begin(); it != spare.end(); ++it)
+                {
+                    if (it->second == bytes) {
+                        void* p = it->first;
+                        spare.erase(it);
+                        kept -= bytes;
+                        return p;
+                    }
+                }
+            }
+            return map_aligned(bytes);
+        }
+        void give(void* p, size_t bytes) noexcept
+        {
+            scoped_lock lock(mtx);
+            if (bytes > ARENA_BYTES) {
+                munmap(p, bytes);
+                return;
+            }
+            // the oldest blocks go first to make room
+            auto it = spare.begin();
+            for (; it != spare.end() && kept + bytes > ARENA_BYTES; ++it)
+            {
+                munmap(it->first, it->second);
+                kept -= it->second;
+            }
+            spare.erase(spare.begin(), it);
+            try
+            {
+                spare.push_back({ p, bytes });
+                kept += bytes;
+            }
+            catch (...) {
+                munmap(p, bytes);
+            }
+        }
+        void release() noexcept
+        {
+            scoped_lock lock(mtx);
+            for (auto [p, bytes] : spare)
+                munmap(p, bytes);
+            spare.clear();
+            kept = 0;
+        }
+    };
+
+    // never destroyed, tables of static objects may still be released into it at exit
+    Arena& arena = *new Arena;
+#endif
+
+}
+
+void hugepages::release() noexcept
+{
+#if defined(HUGEPAGES_MMAP)
+    arena.release();
+#endif
+}
+
+void hugepages::enable(bool on)
+{
+    use_huge = on;
+}
+
+bool hugepages::enabled()
+{
+#if defined(HUGEPAGES_MMAP)
+    return use_huge;
+#else
+    return false;
+#endif
+}
+
+void* hugepages::allocate(size_t bytes)
+{
+#if defined(HUGEPAGES_MMAP)
+    if (use_huge && bytes >= HUGE_MIN)
+        return arena.take(round_up(bytes));
+#endif
+    return ::operator new(bytes);
+}
+
+void hugepages::deallocate(void* p, size_t bytes) noexcept
+{
+#if defined(HUGEPAGES_MMAP)
+    if (use_huge && bytes >= HUGE_MIN) {
+        arena.give(p, round_up(bytes));
+        return;
+    }
+#endif
+    ::operator delete(p);
+}
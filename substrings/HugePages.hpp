@@ -0,0 +1,81 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Large blocks on 2 MiB transparent huge pages where the platform has them, so that random
+// probes into big hash tables miss the TLB less often. Smaller blocks and platforms without
+// huge pages go to operator new.
+namespace hugepages
+{
+
+    constexpr std::size_t HUGE_PAGE = std::size_t(2) << 20;
+    // below this a block would waste most of its huge page
+    constexpr std::size_t HUGE_MIN = HUGE_PAGE / 2;
+
+    // must be called before the first allocation, blocks are released the way they were taken
+    void enable(bool on);
+    bool enabled();
+    void* allocate(std::size_t bytes);
+    void deallocate(void* p, std::size_t bytes) noexcept;
+    // unmaps the released blocks kept for reuse
+    void release() noexcept;
+
+    // Empties a table but keeps its slots for the next chunk, where clear() frees those of a large one
+    template<typename Table>
+    void keep_clear(Table& table)
+    {
+        table.erase(table.begin(), table.end());
+    }
+    // room for count keys, a table emptied by keep_clear that already has it isn't rehashed
+    template<typename Table>
+    void keep_reserve(Table& table, std::size_t count)
+    {
+        if (count > table.capacity() / 8 * 7)
+            table.reserve(count);
+    }
+
+}
+
+template<typename T>
+struct HugePageAllocator
+{
+    using value_type = T;
+
+    HugePageAllocator() noexcept = default;
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(hugepages::allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        hugepages::deallocate(p, n * sizeof(T));
+    }
+    template<typename U>
+    bool operator==(const HugePageAllocator<U>&) const noexcept { return true; }
+};
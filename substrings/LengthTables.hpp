@@ -0,0 +1,185 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <string_view>
+
+#include <phmap.h>
+#include "HugePages.hpp"
+
+namespace substrings
+{
+
+    constexpr auto MIN_FIXED = 7u;
+    constexpr auto MAX_FIXED = 64u;
+
+    // Equality of two Len byte windows with loads of a width known at compile time
+    template<std::size_t Len>
+    inline bool fixed_equal(const char* a, const char* b)
+    {
+#if defined(SIMD_SSE2)
+        if constexpr (Len >= 16) {
+            std::size_t i = 0;
+            for (; i + 16 < Len; i += 16) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+                __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+                    return false;
+            }
+            // the last block overlaps the previous one instead of reading past the window
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + Len - 16));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + Len - 16));
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+        }
+        else
+#endif
+            return std::memcmp(a, b, Len) == 0;
+    }
+
+    // Windows of one length are keyed by their offset in the chunk, the functors read the bytes
+    // through the shared base pointer, so a slot takes 8 bytes instead of a view and a 64-bit count
+    template<std::size_t Len>
+    struct FixedHash
+    {
+        const char* const* base;
+        std::size_t operator()(std::uint32_t offset) const noexcept
+        {
+            const char* p = *base + offset;
+            std::uint64_t h = Len, w;
+            if constexpr (Len < 8) {
+                std::uint32_t lo, hi;
+                std::memcpy(&lo, p, 4);
+                std::memcpy(&hi, p + Len - 4, 4);
+                h = (h ^ (std::uint64_t(hi) << 32 | lo)) * 0x9e3779b97f4a7c15ull;
+            }
+            else {
+                for (std::size_t i = 0; i + 8 < Len; i += 8) {
+                    std::memcpy(&w, p + i, 8);
+                    h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+                }
+                std::memcpy(&w, p + Len - 8, 8);
+                h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+            }
+            return static_cast<std::size_t>(h ^ (h >> 32));
+        }
+    };
+
+    template<std::size_t Len>
+    struct FixedEqual
+    {
+        const char* const* base;
+        bool operator()(std::uint32_t l, std::uint32_t r) const noexcept
+        {
+            return l == r || fixed_equal<Len>(*base + l, *base + r);
+        }
+    };
+
+    template<std::size_t Len>
+    using FixedTable = phmap::flat_hash_map<std::uint32_t, std::uint32_t, FixedHash<Len>, FixedEqual<Len>,
+        HugePageAllocator<std::pair<const std::uint32_t, std::uint32_t>>>;
+
+    // One table per length from MIN_FIXED to MAX_FIXED over the chunk given to reset(),
+    // counts are 32-bit as a chunk never exceeds 4 GiB here
+    class LengthTables final
+    {
+    protected:
+        template<std::size_t... I>
+        static auto make_tables(std::index_sequence<I...>) -> std::tuple<FixedTable<MIN_FIXED + I>...>;
+
+        const char* base;
+        decltype(make_tables(std::make_index_sequence<MAX_FIXED - MIN_FIXED + 1>{})) tables;
+    public:
+        LengthTables() : LengthTables(std::make_index_sequence<MAX_FIXED - MIN_FIXED + 1>{}) {}
+        // the functors point at base
+        LengthTables(const LengthTables&) = delete;
+        LengthTables& operator=(const LengthTables&) = delete;
+
+        static bool fixed(std::size_t length)
+        {
+            return length >= MIN_FIXED && length <= MAX_FIXED;
+        }
+        void reset(std::string_view chunk)
+        {
+            std::apply([](auto&... t) { (hugepages::keep_clear(t), ...); }, tables);
+            base = chunk.data();
+        }
+        void reserve(std::size_t length, std::size_t count)
+        {
+            with(length, [=](auto& table) { hugepages::keep_reserve(table, count); });
+        }
+        std::size_t size() const
+        {
+            return std::apply([](const auto&... t) { return (t.size() + ...); }, tables);
+        }
+        // bytes held by the slots, one control byte each
+        std::size_t footprint() const
+        {
+            return std::apply([](const auto&... t) { return ((t.capacity() * (sizeof(*t.begin()) + 1)) + ...); }, tables);
+        }
+        template<std::size_t Len>
+        FixedTable<Len>& table()
+        {
+            static_assert(Len >= MIN_FIXED && Len <= MAX_FIXED);
+            return std::get<Len - MIN_FIXED>(tables);
+        }
+        // calls fn with the table of the given length, which must be fixed
+        template<typename F>
+        void with(std::size_t length, F&& fn)
+        {
+            with_n(length, fn, std::make_index_sequence<MAX_FIXED - MIN_FIXED + 1>{});
+        }
+        // fn(key, count, offset of its first occurrence)
+        template<typename F>
+        void for_each(F&& fn) const
+        {
+            std::apply([&](const auto&... t) { (for_each_in(t, fn), ...); }, tables);
+        }
+    protected:
+        template<std::size_t... I>
+        explicit LengthTables(std::index_sequence<I...>) :
+            base(nullptr),
+            tables(FixedTable<MIN_FIXED + I>(0, FixedHash<MIN_FIXED + I>{ &base }, FixedEqual<MIN_FIXED + I>{ &base })...)
+        {}
+        template<typename F, std::size_t... I>
+        void with_n(std::size_t length, F& fn, std::index_sequence<I...>)
+        {
+            static_cast<void>(((length == MIN_FIXED + I && (fn(std::get<I>(tables)), true)) || ...));
+        }
+        template<std::size_t Len, typename F>
+        void for_each_in(const FixedTable<Len>& table, F& fn) const
+        {
+            for (const auto& [offset, count] : table)
+                fn(std::string_view(base + offset, Len), count, offset);
+        }
+    };
+
+}
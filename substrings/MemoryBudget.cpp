@@ -0,0 +1,110 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include "MemoryBudget.hpp"
+
+using namespace std;
+
+MemoryBudget::Lease::Lease(MemoryBudget& budget, size_t bytes) : budget(budget), bytes(bytes)
+{
+    budget.acquire(bytes);
+}
+
+MemoryBudget::Lease::~Lease()
+{
+    budget.release(bytes);
+}
+
+void MemoryBudget::Lease::resize(size_t to)
+{
+    budget.charge(bytes, to);
+    bytes = to;
+}
+
+MemoryBudget::Charge::Charge(MemoryBudget& budget, size_t bytes) : budget(&budget), bytes(bytes)
+{
+    budget.charge(0, bytes);
+}
+
+MemoryBudget::Charge::Charge(Charge&& other) noexcept : budget(other.budget), bytes(other.bytes)
+{
+    other.bytes = 0;
+}
+
+MemoryBudget::Charge::~Charge()
+{
+    budget->charge(bytes, 0);
+}
+
+void MemoryBudget::Charge::resize(size_t to)
+{
+    budget->charge(bytes, to);
+    bytes = to;
+}
+
+MemoryBudget::MemoryBudget(size_t limit) : limit(limit), used(0), peak(0), leases(0) {}
+
+MemoryBudget::~MemoryBudget() {}
+
+void MemoryBudget::acquire(size_t bytes)
+{
+    unique_lock lock(mtx);
+    // a lone task always proceeds, otherwise an oversized one would wait forever
+    freed.wait(lock, [&] { return !leases || used + bytes <= limit; });
+    ++leases;
+    used += bytes;
+    peak = max(peak, used);
+}
+
+void MemoryBudget::release(size_t bytes)
+{
+    {
+        scoped_lock lock(mtx);
+        --leases;
+        used -= min(used, bytes);
+    }
+    freed.notify_all();
+}
+
+void MemoryBudget::charge(size_t from, size_t to)
+{
+    {
+        scoped_lock lock(mtx);
+        used = used - min(used, from) + to;
+        peak = max(peak, used);
+    }
+    if (to < from)
+        freed.notify_all();
+}
+
+size_t MemoryBudget::in_use()
+{
+    scoped_lock lock(mtx);
+    return used;
+}
+
+size_t MemoryBudget::get_peak()
+{
+    scoped_lock lock(mtx);
+    return peak;
+}
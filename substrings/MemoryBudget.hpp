@@ -0,0 +1,80 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+
+// Byte accounting shared by the worker tasks and the reduced table. Tasks take a lease
+// before loading a slice and wait while it would overflow the limit, the table is
+// charged without waiting so that reduction can be decided from the total in use.
+class MemoryBudget final
+{
+protected:
+    std::mutex mtx;
+    std::condition_variable freed;
+    std::size_t limit, used, peak;
+    unsigned leases;
+public:
+    class Lease final
+    {
+    protected:
+        MemoryBudget& budget;
+        std::size_t bytes;
+    public:
+        Lease(MemoryBudget& budget, std::size_t bytes);
+        ~Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        // the real size once known, may exceed the limit as the task is already running
+        void resize(std::size_t to);
+    };
+    // Bytes held outside a lease, charged without waiting and given back when it goes, so a budget
+    // shared by several passes only counts what the running ones hold
+    class Charge final
+    {
+    protected:
+        MemoryBudget* budget;
+        std::size_t bytes;
+    public:
+        Charge(MemoryBudget& budget, std::size_t bytes = 0);
+        Charge(Charge&& other) noexcept;
+        ~Charge();
+        Charge& operator=(Charge&&) = delete;
+        void resize(std::size_t to);
+        std::size_t size() const { return bytes; }
+    };
+
+    explicit MemoryBudget(std::size_t limit);
+    ~MemoryBudget();
+    void charge(std::size_t from, std::size_t to);
+    std::size_t get_limit() const { return limit; }
+    std::size_t in_use();
+    std::size_t get_peak();
+    // above the high water mark the table has to be reduced before more tasks add to it
+    bool pressed() { return in_use() > limit / 4 * 3; }
+protected:
+    void acquire(std::size_t bytes);
+    void release(std::size_t bytes);
+};
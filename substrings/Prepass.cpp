@@ -0,0 +1,60 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <bit>
+#include <algorithm>
+#include "Prepass.hpp"
+#include "Substrings.hpp"
+
+using namespace std;
+using namespace substrings;
+
+Prepass::Prepass() : ecache(make_unique<EntropyCache>()), limit(0), min_ent(MIN_ENT), max_ent(MAX_ENT) {}
+
+Prepass::~Prepass() {}
+
+size_t Prepass::footprint() const
+{
+    size_t words = nonascii.capacity() + window.capacity();
+    for (const auto& bits : spans)
+        words += bits.capacity();
+    for (const auto& bits : accepted)
+        words += bits.capacity();
+    return words * sizeof(uint64_t);
+}
+
+void Prepass::build(string_view data, size_t starts, const vector<size_t>& lengths, unsigned stride, bool ascii, bool filter)
+{
+    begin(data, starts, lengths.size(), ascii);
+    for (size_t i = 0; i < lengths.size(); ++i)
+        accept(data, i, lengths[i], stride, ascii, filter);
+}
+
+void Prepass::begin(string_view data, size_t starts, size_t count, bool ascii)
+{
+    limit = starts;
+    accepted.resize(count);
+    if (ascii) {
+        simd::high_bytes(data, nonascii);
+        spans.assign(1, nonascii);
+    }
+}
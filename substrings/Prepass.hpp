@@ -0,0 +1,181 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <bit>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <string_view>
+#include <type_traits>
+#include "Simd.hpp"
+#include "EntropyCache.hpp"
+
+// Per-chunk validity tables: for every probed length a bitmap of the starts whose window
+// and all shorter probed windows pass the ASCII and entropy filters, so a counting loop
+// needs only bit lookups and can jump over rejected regions.
+class Prepass final
+{
+protected:
+    simd::Bitmap nonascii, window;
+    std::vector<simd::Bitmap> spans;
+    std::vector<simd::Bitmap> accepted;
+    std::unique_ptr<EntropyCache> ecache;
+    std::size_t limit;
+    float min_ent, max_ent;
+public:
+    Prepass();
+    ~Prepass();
+    // windows of entropy outside (lo, hi) are rejected by the filter
+    void set_entropy(float lo, float hi)
+    {
+        min_ent = lo;
+        max_ent = hi;
+    }
+    float min_entropy() const { return min_ent; }
+    float max_entropy() const { return max_ent; }
+    void build(std::string_view data, std::size_t starts, const std::vector<std::size_t>& lengths,
+        unsigned stride, bool ascii, bool filter);
+    // build() at stride 1 for the lengths and filters of a counting kernel, the window widths,
+    // span shifts and entropy divisors are all constants
+    template<bool Ascii, bool Filter, std::size_t... Len>
+    void build(std::string_view data, std::size_t starts);
+    std::size_t footprint() const;
+    // i-th probed length is accepted at start
+    bool accepts(std::size_t i, std::size_t start) const
+    {
+        return simd::test(accepted[i], start);
+    }
+    // calls fn(start) for every start where the i-th probed length is accepted
+    template<typename F>
+    void for_each(std::size_t i, F&& fn) const
+    {
+        const auto& bits = accepted[i];
+        for (std::size_t w = 0; w < bits.size() && w * 64 < limit; ++w) {
+            std::uint64_t word = bits[w];
+            while (word != 0) {
+                const std::size_t start = w * 64 + std::countr_zero(word);
+                if (start >= limit)
+                    return;
+                fn(start);
+                word &= word - 1;
+            }
+        }
+    }
+    // first start at or after from where the shortest probed length is accepted
+    std::size_t next(std::size_t from) const
+    {
+        return accepted.empty() ? limit : simd::next_set(accepted.front(), from, limit);
+    }
+protected:
+    // the length and stride are std::size_t and unsigned or integral_constants of them
+    void begin(std::string_view data, std::size_t starts, std::size_t count, bool ascii);
+    void accept(std::string_view data, std::size_t i, auto length, auto stride, bool ascii, bool filter);
+    void mark_spans(auto length);
+    void filter_entropy(std::string_view data, simd::Bitmap& bits, auto length, auto stride);
+};
+
+template<bool Ascii, bool Filter, std::size_t... Len>
+void Prepass::build(std::string_view data, std::size_t starts)
+{
+    begin(data, starts, sizeof...(Len), Ascii);
+    [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+        (accept(data, I, std::integral_constant<std::size_t, Len>{}, std::integral_constant<unsigned, 1>{}, Ascii, Filter), ...);
+    }(std::make_index_sequence<sizeof...(Len)>{});
+}
+
+inline void Prepass::accept(std::string_view data, std::size_t i, auto length, auto stride, bool ascii, bool filter)
+{
+    const std::size_t size = data.length();
+    const std::size_t words = (size + 63) / 64;
+    auto& bits = accepted[i];
+    if (i == 0) {
+        if (stride == 1)
+            bits.assign(words, ~std::uint64_t(0));
+        else {
+            bits.assign(words, 0);
+            for (std::size_t start = 0; start < limit; start += stride)
+                bits[start / 64] |= std::uint64_t(1) << (start % 64);
+        }
+        simd::clear_from(bits, limit);
+    }
+    else
+        bits = accepted[i - 1];
+    simd::clear_from(bits, (length <= size) ? size - length + 1 : 0);
+    if (ascii) {
+        // a window is ascii when no high byte falls into it
+        mark_spans(length);
+        for (std::size_t w = 0; w < words; ++w)
+            bits[w] &= ~window[w];
+    }
+    if (filter)
+        filter_entropy(data, bits, length, stride);
+}
+
+inline void Prepass::mark_spans(auto length)
+{
+    // spans[k] marks the starts of 2^k byte windows holding a high byte
+    const std::size_t top = std::bit_width(static_cast<std::size_t>(length)) - 1;
+    while (spans.size() <= top) {
+        const std::size_t width = std::size_t(1) << (spans.size() - 1);
+        simd::Bitmap next = spans.back();
+        simd::shift_or(next, spans.back(), width);
+        spans.push_back(std::move(next));
+    }
+    window = spans[top];
+    simd::shift_or(window, spans[top], length - (std::size_t(1) << top));
+}
+
+inline void Prepass::filter_entropy(std::string_view data, simd::Bitmap& bits, auto length, auto stride)
+{
+    ecache->restart();
+    // the cache takes an unsigned width, or a constant one when the length is a constant
+    const auto len = [&]
+    {
+        if constexpr (std::is_integral_v<decltype(length)>)
+            return static_cast<unsigned>(length);
+        else
+            return std::integral_constant<unsigned, static_cast<unsigned>(decltype(length)::value)>{};
+    }();
+    std::size_t rolled = limit;
+    for (std::size_t w = 0; w < bits.size(); ++w)
+    {
+        std::uint64_t word = bits[w], keep = word;
+        while (word != 0) {
+            const auto bit = std::countr_zero(word);
+            const std::size_t start = w * 64 + bit;
+            word &= word - 1;
+            // walk over short gaps so the cache slides its window instead of recounting it
+            if (stride == 1 && rolled < start && start - rolled <= length) {
+                for (std::size_t pos = rolled + 1; pos < start; ++pos)
+                    ecache->estimate(data.substr(pos, length), pos, len);
+            }
+            float ent = ecache->estimate(data.substr(start, length), start, len);
+            rolled = start;
+            if (ent >= max_ent || ent <= min_ent)
+                keep &= ~(std::uint64_t(1) << bit);
+        }
+        bits[w] = keep;
+    }
+}
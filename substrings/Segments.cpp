@@ -0,0 +1,320 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <format>
+#include "Segments.hpp"
+
+using namespace std;
+
+constexpr uint32_t ELF_PT_LOAD = 1;
+constexpr uint16_t ELF_PN_XNUM = 0xffff;
+constexpr uint32_t MD_SIGNATURE = 0x504d444d; // "MDMP"
+constexpr uint32_t MD_MEMORY_LIST = 5;
+constexpr uint32_t MD_MEMORY64_LIST = 9;
+constexpr uint32_t MD_MEMORY_INFO_LIST = 16;
+constexpr size_t MD_MEMORY_INFO_SIZE = 48;
+
+// little-endian field at pos, zero when it lies outside of the buffer
+template<typename T>
+static T get(const string& buf, size_t pos)
+{
+    T v{};
+    if (pos + sizeof(T) <= buf.size())
+        memcpy(&v, buf.data() + pos, sizeof(T));
+    return v;
+}
+
+// reads length bytes at offset, but never past the end of a file of size bytes, whatever a header claims
+static string read_at(ifstream& f, uint64_t offset, uint64_t length, uint64_t size)
+{
+    length = (offset < size) ? min(length, size - offset) : 0;
+    string buf(static_cast<size_t>(length), '\0');
+    f.clear();
+    f.seekg(static_cast<streamoff>(offset));
+    f.read(buf.data(), static_cast<streamsize>(length));
+    buf.resize(static_cast<size_t>(max<streamsize>(f.gcount(), 0)));
+    return buf;
+}
+
+static unsigned windows_perms(uint32_t protect)
+{
+    switch (protect & 0xff) {
+    case 0x01: return 0;                            // PAGE_NOACCESS
+    case 0x02: return PERM_R;                       // PAGE_READONLY
+    case 0x04:                                      // PAGE_READWRITE
+    case 0x08: return PERM_R | PERM_W;              // PAGE_WRITECOPY
+    case 0x10: return PERM_X;                       // PAGE_EXECUTE
+    case 0x20: return PERM_R | PERM_X;              // PAGE_EXECUTE_READ
+    case 0x40:                                      // PAGE_EXECUTE_READWRITE
+    case 0x80: return PERM_R | PERM_W | PERM_X;     // PAGE_EXECUTE_WRITECOPY
+    default: return PERM_UNKNOWN;
+    }
+}
+
+Segments::Segments() : size(0), layout(Layout::Flat), codec(Codec::None) {}
+
+Segments::~Segments() {}
+
+void Segments::load(const string& path, bool flat)
+{
+    this->path = path;
+    size = filesystem::file_size(path);
+    layout = Layout::Flat;
+    items.clear();
+    bytes = {};
+    frames.clear();
+    ifstream f(path, ios::in | ios::binary);
+    const string head = read_at(f, 0, 64, size);
+    codec = detect_codec(head);
+    if (compressed()) {
+        if (!codec_available(codec))
+            throw runtime_error(format("{} is {} compressed, which this build can't read", path, codec_name(codec)));
+        if (codec == Codec::Zstd)
+            frames = zstd_frames(path);
+        size = frames.empty() ? UNKNOWN_SIZE : frames.back().content + frames.back().size;
+    }
+    else if (!flat) {
+        if (load_elf(head, f))
+            layout = Layout::Elf;
+        else if (load_minidump(head, f))
+            layout = Layout::Minidump;
+    }
+    if (layout == Layout::Flat)
+        items.assign(1, { 0, size, 0, PERM_UNKNOWN });
+    else
+        normalize();
+}
+
+void Segments::assign(string_view data)
+{
+    path.clear();
+    codec = Codec::None;
+    frames.clear();
+    bytes = data.data() ? data : string_view("", 0);
+    size = data.size();
+    layout = Layout::Flat;
+    items.assign(1, { 0, size, 0, PERM_UNKNOWN });
+}
+
+void Segments::filter(const string& mask)
+{
+    static constexpr unsigned bits[] = { PERM_R, PERM_W, PERM_X };
+    erase_if(items, [&](const Segment& seg)
+        {
+            if (seg.perms & PERM_UNKNOWN)
+                return false;
+            for (size_t i = 0; i < std::size(bits); ++i)
+            {
+                const bool has = seg.perms & bits[i];
+                if ((mask[i] == '-' && has) || (mask[i] != '-' && mask[i] != '.' && !has))
+                    return true;
+            }
+            return false;
+        });
+}
+
+void Segments::clip(size_t offset, size_t length)
+{
+    const size_t end = (length && offset + length > offset) ? offset + length : numeric_limits<size_t>::max();
+    vector<Segment> kept;
+    for (auto seg : items)
+    {
+        const size_t lo = max(seg.offset, offset), hi = min(seg.offset + seg.length, end);
+        if (lo >= hi)
+            continue;
+        seg.vaddr += lo - seg.offset;
+        seg.length = hi - lo;
+        seg.offset = lo;
+        kept.push_back(seg);
+    }
+    items.swap(kept);
+}
+
+uint64_t Segments::address(size_t offset) const
+{
+    auto it = upper_bound(items.begin(), items.end(), offset, [](size_t o, const Segment& seg) { return o < seg.offset; });
+    if (it == items.begin() || offset >= prev(it)->offset + prev(it)->length)
+        return offset;
+    --it;
+    return it->vaddr + (offset - it->offset);
+}
+
+bool Segments::valid_mask(const string& mask)
+{
+    static const string letters = "rwx";
+    if (mask.size() != letters.size())
+        return false;
+    for (size_t i = 0; i < mask.size(); ++i)
+    {
+        if (mask[i] != letters[i] && mask[i] != '-' && mask[i] != '.')
+            return false;
+    }
+    return true;
+}
+
+bool Segments::load_elf(const string& head, ifstream& f)
+{
+    // only little-endian ELF32/ELF64 headers are understood
+    if (head.size() < 52 || head.compare(0, 4, "\x7f" "ELF") != 0 || head[5] != 1)
+        return false;
+    const bool is64 = head[4] == 2;
+    if (!is64 && head[4] != 1)
+        return false;
+    const uint64_t phoff = is64 ? get<uint64_t>(head, 32) : get<uint32_t>(head, 28);
+    const size_t phentsize = get<uint16_t>(head, is64 ? 54 : 42);
+    size_t phnum = get<uint16_t>(head, is64 ? 56 : 44);
+    if (phnum == ELF_PN_XNUM) { // the real count lives in sh_info of the first section header
+        const uint64_t shoff = is64 ? get<uint64_t>(head, 40) : get<uint32_t>(head, 32);
+        phnum = get<uint32_t>(read_at(f, shoff, 64, size), is64 ? 44 : 28);
+    }
+    const uint64_t length = static_cast<uint64_t>(phnum) * phentsize;
+    if (phentsize < (is64 ? 56u : 32u) || phoff >= size || length > size - phoff)
+        return false;
+    const string table = read_at(f, phoff, length, size);
+    for (size_t at = 0; at + phentsize <= table.size(); at += phentsize)
+    {
+        if (get<uint32_t>(table, at) != ELF_PT_LOAD)
+            continue;
+        if (is64)
+            add(get<uint64_t>(table, at + 8), get<uint64_t>(table, at + 32), get<uint64_t>(table, at + 16), get<uint32_t>(table, at + 4));
+        else
+            add(get<uint32_t>(table, at + 4), get<uint32_t>(table, at + 16), get<uint32_t>(table, at + 8), get<uint32_t>(table, at + 24));
+    }
+    return !items.empty();
+}
+
+bool Segments::load_minidump(const string& head, ifstream& f)
+{
+    if (head.size() < 16 || get<uint32_t>(head, 0) != MD_SIGNATURE)
+        return false;
+    struct Region {
+        uint64_t base, length;
+        unsigned perms;
+    };
+    vector<Region> regions;
+    const uint64_t dir_rva = get<uint32_t>(head, 12), dir_size = static_cast<uint64_t>(get<uint32_t>(head, 8)) * 12;
+    if (dir_rva >= size || dir_size > size - dir_rva)
+        return false;
+    const string dir = read_at(f, dir_rva, dir_size, size);
+    for (size_t at = 0; at + 12 <= dir.size(); at += 12)
+    {
+        const uint32_t type = get<uint32_t>(dir, at);
+        if (type != MD_MEMORY_LIST && type != MD_MEMORY64_LIST && type != MD_MEMORY_INFO_LIST)
+            continue;
+        const string stream = read_at(f, get<uint32_t>(dir, at + 8), get<uint32_t>(dir, at + 4), size);
+        if (type == MD_MEMORY_LIST) {
+            const uint32_t count = get<uint32_t>(stream, 0);
+            for (size_t i = 0, pos = 4; i < count && pos + 16 <= stream.size(); ++i, pos += 16)
+                add(get<uint32_t>(stream, pos + 12), get<uint32_t>(stream, pos + 8), get<uint64_t>(stream, pos), PERM_UNKNOWN);
+        }
+        else if (type == MD_MEMORY64_LIST) {
+            // the ranges are stored back to back starting from BaseRva
+            const uint64_t count = get<uint64_t>(stream, 0);
+            uint64_t rva = get<uint64_t>(stream, 8);
+            for (size_t i = 0, pos = 16; i < count && pos + 16 <= stream.size(); ++i, pos += 16)
+            {
+                const uint64_t length = get<uint64_t>(stream, pos + 8);
+                add(rva, length, get<uint64_t>(stream, pos), PERM_UNKNOWN);
+                rva += length;
+            }
+        }
+        else {
+            const uint32_t header = get<uint32_t>(stream, 0), entry = get<uint32_t>(stream, 4);
+            const uint64_t count = get<uint64_t>(stream, 8);
+            if (entry < MD_MEMORY_INFO_SIZE)
+                continue;
+            for (size_t i = 0, pos = header; i < count && pos + entry <= stream.size(); ++i, pos += entry)
+                regions.push_back({ get<uint64_t>(stream, pos), get<uint64_t>(stream, pos + 24), windows_perms(get<uint32_t>(stream, pos + 36)) });
+        }
+    }
+    if (regions.empty())
+        return !items.empty();
+
+    // split the ranges along the memory info regions to learn their protection
+    ranges::sort(regions, {}, &Region::base);
+    vector<Segment> split;
+    for (const auto& seg : items)
+    {
+        uint64_t pos = seg.vaddr;
+        const uint64_t end = seg.vaddr + seg.length;
+        auto it = ranges::upper_bound(regions, pos, {}, &Region::base);
+        if (it != regions.begin())
+            --it;
+        while (pos < end) {
+            while (it != regions.end() && it->base + it->length <= pos)
+                ++it;
+            uint64_t stop = end;
+            unsigned perms = PERM_UNKNOWN;
+            if (it != regions.end() && it->base <= pos) {
+                stop = min(end, it->base + it->length);
+                perms = it->perms;
+            }
+            else if (it != regions.end())
+                stop = min(end, it->base);
+            split.push_back({ seg.offset + static_cast<size_t>(pos - seg.vaddr), static_cast<size_t>(stop - pos), pos, perms });
+            pos = stop;
+        }
+    }
+    items.swap(split);
+    return !items.empty();
+}
+
+void Segments::add(uint64_t offset, uint64_t length, uint64_t vaddr, unsigned perms)
+{
+    if (offset >= size || length == 0)
+        return;
+    length = min<uint64_t>(length, size - offset);
+    items.push_back({ static_cast<size_t>(offset), static_cast<size_t>(length), vaddr, perms });
+}
+
+void Segments::normalize()
+{
+    // the same memory may be listed more than once, keep every address range only once
+    ranges::sort(items, [](const Segment& l, const Segment& r)
+        {
+            return (l.vaddr == r.vaddr) ? l.length > r.length : l.vaddr < r.vaddr;
+        });
+    vector<Segment> unique;
+    uint64_t covered = 0;
+    for (auto seg : items)
+    {
+        const uint64_t end = seg.vaddr + seg.length;
+        if (!unique.empty() && end <= covered)
+            continue;
+        if (!unique.empty() && seg.vaddr < covered) {
+            const auto trim = static_cast<size_t>(covered - seg.vaddr);
+            seg.offset += trim;
+            seg.vaddr += trim;
+            seg.length -= trim;
+        }
+        unique.push_back(seg);
+        covered = max(covered, end);
+    }
+    ranges::sort(unique, {}, &Segment::offset);
+    items.swap(unique);
+}
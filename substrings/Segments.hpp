@@ -0,0 +1,95 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <iosfwd>
+#include "Decompress.hpp"
+
+constexpr unsigned PERM_X = 1u;
+constexpr unsigned PERM_W = 2u;
+constexpr unsigned PERM_R = 4u;
+constexpr unsigned PERM_UNKNOWN = 8u;
+// size of a compressed stream that doesn't state it
+constexpr std::size_t UNKNOWN_SIZE = ~std::size_t(0);
+
+struct Segment
+{
+    std::size_t offset, length;
+    std::uint64_t vaddr;
+    unsigned perms;
+};
+
+// Memory segments of the input: PT_LOAD entries of an ELF core, memory lists of a minidump,
+// or the whole file for anything else. Only little-endian dumps are recognized. The input may
+// also be a buffer in memory, which is then read in place. A compressed file is taken as the
+// flat blob it decompresses to, offsets are then positions in the decompressed stream.
+class Segments final
+{
+public:
+    enum class Layout {
+        Flat,
+        Elf,
+        Minidump
+    };
+protected:
+    std::string path;
+    std::size_t size;
+    Layout layout;
+    std::vector<Segment> items;
+    std::string_view bytes;
+    Codec codec;
+    std::vector<Frame> frames;
+public:
+    Segments();
+    ~Segments();
+    void load(const std::string& path, bool flat = false);
+    // a flat input of the bytes, which must outlive the passes over it
+    void assign(std::string_view data);
+    // Keeps the segments matching a mask like "rw-": a letter requires the permission,
+    // '-' forbids it, '.' accepts both; segments of unknown permissions are kept
+    void filter(const std::string& mask);
+    // Keeps only the file bytes [offset, offset + length) of the segments, length 0 runs to the end
+    void clip(std::size_t offset, std::size_t length);
+    const std::string& file() const { return path; }
+    bool in_memory() const { return bytes.data() != nullptr; }
+    std::string_view memory() const { return bytes; }
+    Codec compression() const { return codec; }
+    bool compressed() const { return codec != Codec::None; }
+    // the zstd frames with their place in the stream, empty if any frame leaves its size out
+    const std::vector<Frame>& frame_list() const { return frames; }
+    std::size_t file_size() const { return size; }
+    Layout kind() const { return layout; }
+    bool mapped() const { return layout != Layout::Flat; }
+    const std::vector<Segment>& list() const { return items; }
+    std::uint64_t address(std::size_t offset) const;
+    static bool valid_mask(const std::string& mask);
+protected:
+    bool load_elf(const std::string& head, std::ifstream& f);
+    bool load_minidump(const std::string& head, std::ifstream& f);
+    void add(std::uint64_t offset, std::uint64_t length, std::uint64_t vaddr, unsigned perms);
+    void normalize();
+};
@@ -0,0 +1,386 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#if !defined(_MSC_BUILD) && !defined(__MINGW32__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#define SERVER_SOCKETS
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+#include <iostream>
+#include <streambuf>
+#include <filesystem>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <format>
+#include <taskflow/taskflow.hpp>
+#include "Server.hpp"
+
+using namespace std;
+using namespace substrings;
+
+namespace
+{
+
+    constexpr size_t IDLE_MAX = 2;
+    // the part of the budget the workers of a kept counter may go on holding
+    constexpr size_t IDLE_KEEP_DIV = 16;
+    constexpr int BACKLOG = 16;
+    constexpr size_t FRAME_SIZE = 4096;
+    constexpr uint32_t REQUEST_WORDS = 1024, REQUEST_WORD = 1u << 16;
+    // a frame is the kind, the payload size and the payload
+    constexpr char OUT_FRAME = 'o', ERR_FRAME = 'e', EXIT_FRAME = 'x';
+
+#if defined(SERVER_SOCKETS)
+    bool write_all(int fd, const void* data, size_t size)
+    {
+        auto p = static_cast<const char*>(data);
+        while (size) {
+            const auto n = send(fd, p, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool read_all(int fd, void* data, size_t size)
+    {
+        auto p = static_cast<char*>(data);
+        while (size) {
+            const auto n = recv(fd, p, size, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // a request is the word count, then the size and the bytes of every word
+    bool write_request(int fd, const vector<string>& words)
+    {
+        const auto count = static_cast<uint32_t>(words.size());
+        if (!write_all(fd, &count, sizeof(count)))
+            return false;
+        for (const auto& word : words)
+        {
+            const auto size = static_cast<uint32_t>(word.size());
+            if (!write_all(fd, &size, sizeof(size)) || !write_all(fd, word.data(), word.size()))
+                return false;
+        }
+        return true;
+    }
+
+    vector<string> read_request(int fd)
+    {
+        uint32_t count = 0;
+        if (!read_all(fd, &count, sizeof(count)) || count == 0 || count > REQUEST_WORDS)
+            throw runtime_error("Malformed request");
+        vector<string> words(count);
+        for (auto& word : words)
+        {
+            uint32_t size = 0;
+            if (!read_all(fd, &size, sizeof(size)) || size > REQUEST_WORD)
+                throw runtime_error("Malformed request");
+            word.resize(size);
+            if (!read_all(fd, word.data(), size))
+                throw runtime_error("Malformed request");
+        }
+        return words;
+    }
+
+    sockaddr_un socket_address(const string& path)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            throw runtime_error(format("Socket path is too long: {}", path));
+        path.copy(addr.sun_path, path.size());
+        return addr;
+    }
+
+    // The output and the error stream of a job write to one connection, a frame at a time. Once the
+    // client is gone the frames are dropped and the job runs to its end.
+    class Connection final
+    {
+    protected:
+        int fd;
+        mutex mtx;
+        bool broken;
+    public:
+        explicit Connection(int fd) : fd(fd), broken(false) {}
+        void send_frame(char kind, string_view payload)
+        {
+            scoped_lock lock(mtx);
+            const auto size = static_cast<uint32_t>(payload.size());
+            broken = broken || !write_all(fd, &kind, 1) || !write_all(fd, &size, sizeof(size))
+                || !write_all(fd, payload.data(), payload.size());
+        }
+    };
+
+    // collects what a stream writes into frames, the workers of a job may write at the same time
+    class FrameBuf final : public streambuf
+    {
+    protected:
+        Connection& conn;
+        char kind;
+        mutex mtx;
+        string pending;
+    public:
+        FrameBuf(Connection& conn, char kind) : conn(conn), kind(kind) {}
+    protected:
+        int_type overflow(int_type c) override
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                scoped_lock lock(mtx);
+                pending.push_back(traits_type::to_char_type(c));
+                if (pending.size() >= FRAME_SIZE)
+                    send_pending();
+            }
+            return traits_type::not_eof(c);
+        }
+        streamsize xsputn(const char* s, streamsize n) override
+        {
+            scoped_lock lock(mtx);
+            pending.append(s, static_cast<size_t>(n));
+            if (pending.size() >= FRAME_SIZE)
+                send_pending();
+            return n;
+        }
+        int sync() override
+        {
+            scoped_lock lock(mtx);
+            send_pending();
+            return 0;
+        }
+        void send_pending()
+        {
+            if (!pending.empty()) {
+                conn.send_frame(kind, pending);
+                pending.clear();
+            }
+        }
+    };
+#endif
+
+}
+
+Server::Server(const string& path, Job job, size_t memory) :
+    path(path), job(move(job)), executor(make_shared<tf::Executor>(max(thread::hardware_concurrency() * 2, 1u))),
+    budget(make_shared<MemoryBudget>(memory ? memory : get_memory_limit())), active(0)
+{
+}
+
+Server::~Server() {}
+
+Server::Shape Server::shape_of(const Settings& settings)
+{
+    return { settings.lmin, settings.lmax, settings.skip, settings.drop, settings.top, settings.alignment, settings.max_memory };
+}
+
+unique_ptr<SubstringsConcurrent> Server::checkout(const Settings& settings)
+{
+    unique_ptr<SubstringsConcurrent> subs;
+    {
+        scoped_lock lock(mtx);
+        auto found = ranges::find(idle, shape_of(settings), &decltype(idle)::value_type::first);
+        if (found != idle.end()) {
+            subs = move(found->second);
+            idle.erase(found);
+        }
+        ++active;
+    }
+    if (!subs) {
+        subs = make_unique<SubstringsConcurrent>(settings.lmin, settings.lmax, settings.skip, settings.drop, settings.top, settings.alignment, settings.max_memory);
+        subs->share_executor(executor);
+        subs->share_budget(budget);
+    }
+    // the workers are split evenly between the jobs running at any moment
+    subs->set_share([this] { return max(static_cast<unsigned>(executor->num_workers()) / max(active.load(), 1u), 1u); });
+    return subs;
+}
+
+void Server::checkin(const Settings& settings, unique_ptr<SubstringsConcurrent> subs)
+{
+    // a failed job gives nothing back, its counter may be in any state
+    unique_ptr<SubstringsConcurrent> evicted;
+    if (subs) {
+        subs->reset();
+        subs->trim(budget->get_limit() / IDLE_KEEP_DIV);
+        subs->set_log(cerr);
+    }
+    scoped_lock lock(mtx);
+    --active;
+    if (!subs)
+        return;
+    idle.emplace_back(shape_of(settings), move(subs));
+    if (idle.size() > IDLE_MAX) {
+        evicted = move(idle.front().second);
+        idle.erase(idle.begin());
+    }
+}
+
+#if defined(SERVER_SOCKETS)
+
+void Server::run()
+{
+    const auto addr = socket_address(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw runtime_error(format("Cannot create a socket: {}", strerror(errno)));
+    // a socket left behind by an earlier server is replaced, any other file is not
+    if (filesystem::is_socket(path))
+        filesystem::remove(path);
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, BACKLOG) < 0) {
+        const auto error = errno;
+        close(fd);
+        throw runtime_error(format("Cannot listen on {}: {}", path, strerror(error)));
+    }
+    cerr << "Serving on " << path << endl;
+    for (;;)
+    {
+        const int client = accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            const auto error = errno;
+            close(fd);
+            throw runtime_error(format("Cannot accept on {}: {}", path, strerror(error)));
+        }
+        thread([this, client] { serve(client); close(client); }).detach();
+    }
+}
+
+void Server::serve(int fd)
+{
+    Connection conn(fd);
+    FrameBuf outbuf(conn, OUT_FRAME), errbuf(conn, ERR_FRAME);
+    ostream out(&outbuf), err(&errbuf);
+    int32_t code = 1;
+    try {
+        // the first word is the directory of the client, the rest its command line
+        const auto words = read_request(fd);
+        vector<const char*> argv{ "substrings" };
+        for (size_t i = 1; i < words.size(); ++i)
+            argv.push_back(words[i].c_str());
+        Settings settings;
+        if (handle_args(static_cast<int>(argv.size()), argv.data(), settings, err)) {
+            if (settings.follow || settings.benchmark || settings.evaluation || !settings.serve.empty())
+                err << "Following, benchmarks and evaluations do not run as jobs" << endl;
+            else {
+                for (auto* file : { &settings.input_file, &settings.baseline_file })
+                {
+                    if (!file->empty())
+                        *file = (filesystem::path(words.front()) / *file).string();
+                }
+                auto subs = checkout(settings);
+                try {
+                    job(settings, *subs, out, err);
+                }
+                catch (...) {
+                    checkin(settings, nullptr);
+                    throw;
+                }
+                checkin(settings, move(subs));
+                code = 0;
+            }
+        }
+    }
+    catch (const exception& ex) {
+        err << "Exception occured: " << ex.what() << endl;
+    }
+    catch (...) {
+        err << "Unknown exception occured!" << endl;
+    }
+    out.flush();
+    err.flush();
+    conn.send_frame(EXIT_FRAME, string_view(reinterpret_cast<const char*>(&code), sizeof(code)));
+}
+
+int submit(const string& path, int argc, char* argv[])
+{
+    const auto addr = socket_address(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        const auto error = errno;
+        if (fd >= 0)
+            close(fd);
+        throw runtime_error(format("Cannot connect to {}: {}", path, strerror(error)));
+    }
+    vector<string> words{ filesystem::current_path().string() };
+    for (int i = 1; i < argc; ++i)
+        words.emplace_back(argv[i]);
+    int32_t code = 1;
+    bool done = false;
+    if (write_request(fd, words)) {
+        char kind;
+        uint32_t size;
+        string payload;
+        while (!done && read_all(fd, &kind, 1) && read_all(fd, &size, sizeof(size)))
+        {
+            payload.resize(size);
+            if (!read_all(fd, payload.data(), size))
+                break;
+            if (kind == EXIT_FRAME) {
+                memcpy(&code, payload.data(), min<size_t>(size, sizeof(code)));
+                done = true;
+            }
+            else
+                (kind == OUT_FRAME ? cout : cerr).write(payload.data(), payload.size()).flush();
+        }
+    }
+    close(fd);
+    if (!done)
+        cerr << "The server closed the connection" << endl;
+    return code;
+}
+
+#else
+
+void Server::run()
+{
+    throw runtime_error("Serving needs Unix domain sockets");
+}
+
+void Server::serve(int fd) {}
+
+int submit(const string& path, int argc, char* argv[])
+{
+    throw runtime_error("Submitting needs Unix domain sockets");
+}
+
+#endif
@@ -0,0 +1,71 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <tuple>
+#include <functional>
+#include <iosfwd>
+#include "Substrings.hpp"
+#include "cli.hpp"
+
+// Resident mode: jobs are command lines sent over a Unix socket and parsed as the tool's own. All of
+// them run on one executor, each limited to its share of the workers, and the counters of a finished
+// job are kept for the next one with the same lengths. The jobs take their leases from one memory
+// budget, and a kept counter holds on to a small part of it at most. The output and the diagnostics
+// of a job are streamed back to the client as they are written.
+class Server final
+{
+public:
+    using Job = std::function<void(const Settings&, substrings::SubstringsConcurrent&, std::ostream& out, std::ostream& err)>;
+protected:
+    // the constructor arguments a counter can be reused for
+    using Shape = std::tuple<std::int64_t, std::int64_t, unsigned, unsigned, std::int64_t, unsigned, std::size_t>;
+    std::string path;
+    Job job;
+    std::shared_ptr<tf::Executor> executor;
+    std::shared_ptr<MemoryBudget> budget;
+    std::mutex mtx;
+    std::vector<std::pair<Shape, std::unique_ptr<substrings::SubstringsConcurrent>>> idle;
+    std::atomic<unsigned> active;
+public:
+    // memory is the budget of all the jobs in bytes, 0 takes the limit of the cgroup or the physical RAM
+    Server(const std::string& path, Job job, std::size_t memory = 0);
+    ~Server();
+    // takes jobs until the process is stopped
+    void run();
+protected:
+    void serve(int fd);
+    std::unique_ptr<substrings::SubstringsConcurrent> checkout(const Settings& settings);
+    void checkin(const Settings& settings, std::unique_ptr<substrings::SubstringsConcurrent> subs);
+    static Shape shape_of(const Settings& settings);
+};
+
+// Sends the command line to the server listening at path and copies what the job writes to the own
+// standard streams, returns the exit code of the job
+int submit(const std::string& path, int argc, char* argv[]);
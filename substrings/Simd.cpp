@@ -0,0 +1,127 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include "Simd.hpp"
+
+using namespace std;
+
+namespace simd
+{
+
+    static bool printable_unit(const char* p)
+    {
+        unsigned unit = static_cast<uint8_t>(p[0]) | (static_cast<uint8_t>(p[1]) << 8);
+        return (unit >= 0x20 && unit < 0x7f) || unit == '\t';
+    }
+
+    void wide_printable(string_view data, Bitmap& bits)
+    {
+        const size_t units = data.length() / 2;
+        const char* p = data.data();
+        size_t i = 0;
+        bits.assign((units + 63) / 64, 0);
+#if defined(SIMD_SSE2)
+        const __m128i lower = _mm_set1_epi16(0x1f), upper = _mm_set1_epi16(0x7f), tab = _mm_set1_epi16('\t');
+        auto classify = [&](const char* q)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q));
+            return _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi16(v, lower), _mm_cmplt_epi16(v, upper)), _mm_cmpeq_epi16(v, tab));
+        };
+        for (; i + 16 <= units; i += 16) {
+            // saturating pack turns the 16-bit lane masks into one byte per code unit
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_packs_epi16(classify(p + i * 2), classify(p + i * 2 + 16))));
+            bits[i / 64] |= static_cast<uint64_t>(mask) << (i % 64);
+        }
+#endif
+        for (; i < units; ++i) {
+            if (printable_unit(p + i * 2))
+                bits[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+
+    void high_bytes(string_view data, Bitmap& bits)
+    {
+        const size_t size = data.length();
+        const char* p = data.data();
+        size_t i = 0;
+        bits.assign((size + 63) / 64, 0);
+#if defined(SIMD_SSE2)
+        for (; i + 16 <= size; i += 16) {
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i))));
+            bits[i / 64] |= static_cast<uint64_t>(mask) << (i % 64);
+        }
+#endif
+        for (; i < size; ++i) {
+            if (static_cast<uint8_t>(p[i]) > 127)
+                bits[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+
+    bool fill_pattern(const char* data, size_t size, uint32_t& pattern)
+    {
+        memcpy(&pattern, data, sizeof(pattern));
+        size_t i = 0;
+#if defined(SIMD_SSE2)
+        const __m128i fill = _mm_set1_epi32(static_cast<int>(pattern));
+        for (; i + 64 <= size; i += 64) {
+            auto p = reinterpret_cast<const __m128i*>(data + i);
+            __m128i eq = _mm_and_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(p), fill), _mm_cmpeq_epi8(_mm_loadu_si128(p + 1), fill)),
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), fill), _mm_cmpeq_epi8(_mm_loadu_si128(p + 3), fill)));
+            if (_mm_movemask_epi8(eq) != 0xffff)
+                return false;
+        }
+#endif
+        for (; i + sizeof(pattern) <= size; i += sizeof(pattern)) {
+            if (memcmp(data + i, &pattern, sizeof(pattern)) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    void shift_or(Bitmap& dst, const Bitmap& src, size_t shift)
+    {
+        const size_t words = shift / 64, bits = shift % 64;
+        for (size_t w = 0; w + words < src.size() && w < dst.size(); ++w) {
+            uint64_t v = src[w + words] >> bits;
+            if (bits != 0 && w + words + 1 < src.size())
+                v |= src[w + words + 1] << (64 - bits);
+            dst[w] |= v;
+        }
+    }
+
+    void clear_from(Bitmap& bits, size_t from)
+    {
+        if (from / 64 >= bits.size())
+            return;
+        bits[from / 64] &= (uint64_t(1) << (from % 64)) - 1;
+        fill(bits.begin() + from / 64 + 1, bits.end(), 0);
+    }
+
+}
@@ -0,0 +1,98 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <bit>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+
+namespace simd
+{
+
+    using Bitmap = std::vector<std::uint64_t>;
+
+    // Sets bit i when the UTF-16LE code unit at data[2 * i] is printable ASCII or a tab
+    void wide_printable(std::string_view data, Bitmap& bits);
+
+    // Sets bit i when data[i] is above 127
+    void high_bytes(std::string_view data, Bitmap& bits);
+
+    // Tells whether the block repeats its first four bytes throughout; size is a multiple of 16
+    bool fill_pattern(const char* data, std::size_t size, std::uint32_t& pattern);
+
+    // dst |= src shifted towards lower positions by shift bits
+    void shift_or(Bitmap& dst, const Bitmap& src, std::size_t shift);
+
+    // Clears all bits from position from onwards
+    void clear_from(Bitmap& bits, std::size_t from);
+
+    inline bool test(const Bitmap& bits, std::size_t pos)
+    {
+        return (bits[pos / 64] >> (pos % 64)) & 1u;
+    }
+
+    inline void reset(Bitmap& bits, std::size_t pos)
+    {
+        bits[pos / 64] &= ~(std::uint64_t(1) << (pos % 64));
+    }
+
+    // Position of the first set bit at or after from, or limit if there is none before it
+    inline std::size_t next_set(const Bitmap& bits, std::size_t from, std::size_t limit)
+    {
+        for (std::size_t w = from / 64; from < limit && w < bits.size(); ++w, from = w * 64) {
+            std::uint64_t word = bits[w] >> (from % 64);
+            if (word != 0)
+                return std::min(from + std::countr_zero(word), limit);
+        }
+        return limit;
+    }
+
+    // Calls fn(begin, length) for every run of set bits among the first count ones
+    template<typename F>
+    void for_each_run(const Bitmap& bits, std::size_t count, std::size_t min_length, F&& fn)
+    {
+        std::size_t pos = 0;
+        while (pos < count) {
+            std::uint64_t word = bits[pos / 64] >> (pos % 64);
+            if (word == 0) {
+                pos = (pos / 64 + 1) * 64;
+                continue;
+            }
+            pos += std::countr_zero(word);
+            std::size_t begin = pos;
+            while (pos < count) {
+                unsigned room = 64 - pos % 64;
+                unsigned ones = std::countr_one(bits[pos / 64] >> (pos % 64));
+                pos += ones;
+                if (ones < room)
+                    break;
+            }
+            pos = std::min(pos, count);
+            if (pos - begin >= min_length)
+                fn(begin, pos - begin);
+        }
+    }
+
+}
@@ -21,14 +21,21 @@
 // THE SOFTWARE.
 
 #include <ranges>
+#include <tuple>
 #include <fstream>
 #include <thread>
 #include <algorithm>
 #include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <atomic>
+#include <memory>
+#include <limits>
+#include <bit>
+#include <format>
 #include <taskflow/taskflow.hpp>
 #include <taskflow/algorithm/for_each.hpp>
 #include "Substrings.hpp"
-#include "EntropyCache.hpp"
 #include "Matcher.hpp"
 #include "system.hpp"
 #include "cli.hpp"
@@ -37,7 +44,13 @@
 using namespace std;
 using namespace substrings;
 
-Substrings::Substrings(size_t minl, size_t maxl, unsigned to_skip) : minl(minl), maxl(maxl), to_skip(to_skip) {}
+Substrings::Substrings(size_t minl, size_t maxl, unsigned to_skip, unsigned align) :
+    minl(minl), maxl(maxl), to_skip(to_skip), align(max(align, 1u)), skipped(0), expected(0), specialized(true)
+{
+    auto probe = [step = length_step()](auto i) { return i % step == 0; };
+    for (size_t length : views::iota(minl, maxl + 1u) | views::filter(probe))
+        lengths.push_back(length);
+}
 
 Substrings::~Substrings() {}
 
@@ -53,173 +66,1084 @@ void Substrings::process_file(const string& path)
     process(sdata);
 }
 
-void Substrings::process(DataView data, bool ascii, bool filter)
+void Substrings::process(DataView data, bool ascii, bool filter, bool wide, bool last)
+{
+    hugepages::keep_clear(keys);
+    fixed.reset(data);
+    words32.clear();
+    words64.clear();
+    skipped = 0;
+    origin = data;
+    // byte windows of the fixed lengths go to the offset keyed tables and whole words to the word tables,
+    // both keep 32-bit offsets
+    const bool narrow = data.length() <= numeric_limits<uint32_t>::max();
+    const bool by_length = !wide && align == 1 && narrow;
+    if (by_length) {
+        for (size_t length : lengths)
+        {
+            if (LengthTables::fixed(length))
+                fixed.reserve(length, expected / lengths.size());
+        }
+    }
+    else
+        hugepages::keep_reserve(keys, expected);
+    if (wide) {
+        process_wide(data, filter, last);
+        return;
+    }
+    const size_t starts = (data.length() > maxl) ? data.length() - maxl : 0;
+    auto count = [&](auto scan_part)
+    {
+        if (!filter || prepass.min_entropy() < FILL_ENT) {
+            scan_part(data, starts);
+            return;
+        }
+        for_each_live(data, starts,
+            [&](size_t from, size_t to) { scan_part(data.substr(from, to - from + maxl), to - from); });
+    };
+    auto with_sink = [&](auto sink) { return [&, sink](DataView part, size_t n) { scan(part, n, ascii, filter, sink); }; };
+    if (narrow && align == WordCounters<uint32_t>::WORD_SIZE)
+        count(with_sink([this](DataView subd) { count_words(words32, subd); }));
+    else if (narrow && align == WordCounters<uint64_t>::WORD_SIZE)
+        count(with_sink([this](DataView subd) { count_words(words64, subd); }));
+    else if (by_length) {
+        if (auto fn = find_kernel(ascii, filter))
+            count([&](DataView part, size_t n) { (this->*fn)(part, n); });
+        else
+            count([&](DataView part, size_t n) { scan_lengths(part, n, ascii, filter); });
+    }
+    else
+        count(with_sink([this](DataView subd) { keys[subd]++; }));
+}
+
+size_t Substrings::footprint() const
+{
+    return keys.capacity() * (sizeof(Keys::value_type) + 1) + fixed.footprint() + words32.footprint() + words64.footprint()
+        + prepass.footprint() + wdata.capacity() + wbits.capacity() * sizeof(uint64_t)
+        + wruns.capacity() * sizeof(wruns[0]);
+}
+
+template<typename Sink>
+void Substrings::scan(DataView data, size_t starts, bool ascii, bool filter, Sink&& sink)
+{
+    prepass.build(data, starts, lengths, align, ascii, filter);
+    for (size_t start = prepass.next(0); start < starts; start = prepass.next(start + 1))
+    {
+        for (size_t i = 0; i < lengths.size() && prepass.accepts(i, start); ++i)
+            sink(data.substr(start, lengths[i]));
+    }
+}
+
+Substrings::Kernel Substrings::find_kernel(bool ascii, bool filter) const
+{
+    Kernel found = nullptr;
+    if (!specialized)
+        return found;
+    auto pick = [&]<typename Range>()
+    {
+        if (found || minl != Range::MIN || maxl != Range::MAX || length_step() != Range::STEP)
+            return;
+        if (ascii)
+            found = filter ? &Substrings::kernel<Range, true, true> : &Substrings::kernel<Range, true, false>;
+        else
+            found = filter ? &Substrings::kernel<Range, false, true> : &Substrings::kernel<Range, false, false>;
+    };
+    [&]<typename... Range>(tuple<Range...>*) { (pick.template operator()<Range>(), ...); }(static_cast<Kernels*>(nullptr));
+    return found;
+}
+
+bool Substrings::has_kernel() const
+{
+    return find_kernel(false, false) != nullptr;
+}
+
+void Substrings::scan_lengths(DataView data, size_t starts, bool ascii, bool filter)
 {
-    EntropyCache ecache;
-    keys.clear();
-    auto skip = [this](auto i) { return i % to_skip == 0; };
-    for (size_t start : views::iota( 0u, data.length() - maxl))
+    // length by length, so each pass touches one table and compares windows of a constant width
+    prepass.build(data, starts, lengths, align, ascii, filter);
+    const auto shift = static_cast<uint32_t>(data.data() - origin.data());
+    for (size_t i = 0; i < lengths.size(); ++i)
     {
-        for (size_t length : views::iota(minl, maxl + 1u) | views::filter(skip))
+        const size_t length = lengths[i];
+        if (!LengthTables::fixed(length)) {
+            prepass.for_each(i, [&](size_t start) { keys[data.substr(start, length)]++; });
+            continue;
+        }
+        fixed.with(length, [&](auto& table) { prepass.for_each(i, [&](size_t start) { table[shift + static_cast<uint32_t>(start)]++; }); });
+    }
+}
+
+template<typename Range, bool Ascii, bool Filter>
+void Substrings::kernel(DataView data, size_t starts)
+{
+    // scan_lengths with the lengths and flags fixed at compile time: the prepass builds its bitmaps
+    // for constant widths, the length loop is unrolled and every length goes straight to its table
+    const auto shift = static_cast<uint32_t>(data.data() - origin.data());
+    [&]<size_t... I>(index_sequence<I...>)
+    {
+        prepass.build<Ascii, Filter, (Range::FIRST + I * Range::STEP)...>(data, starts);
+        auto count_length = [&]<size_t Len>(size_t i)
         {
-            DataView subd = data.substr(start, length);
-            if (ascii && !is_ascii(subd))
+            auto& table = fixed.table<Len>();
+            prepass.for_each(i, [&](size_t start) { table[shift + static_cast<uint32_t>(start)]++; });
+        };
+        (count_length.template operator()<Range::FIRST + I * Range::STEP>(I), ...);
+    }(make_index_sequence<Range::COUNT>{});
+}
+
+template<typename F>
+void Substrings::for_each_live(DataView data, size_t starts, F&& fn)
+{
+    // Calls fn(from, to) for the ranges of starts left after dropping the windows that lie
+    // entirely within a run of pages filled with one four-byte pattern
+    size_t from = 0, page = 0;
+    uint32_t pattern, next;
+    while (page + FILL_PAGE <= data.length() && page < starts)
+    {
+        if (!simd::fill_pattern(data.data() + page, FILL_PAGE, pattern)) {
+            page += FILL_PAGE;
+            continue;
+        }
+        const size_t begin = page;
+        for (page += FILL_PAGE; page + FILL_PAGE <= data.length(); page += FILL_PAGE)
+        {
+            if (!simd::fill_pattern(data.data() + page, FILL_PAGE, next) || next != pattern)
                 break;
-            if (filter) {
-                float ent = ecache.estimate(subd, start, static_cast<unsigned>(length));
-                if (ent >= MAX_ENT || ent <= MIN_ENT)
-                    break;
-            }
-            keys[subd]++;
         }
+        if (page < begin + maxl + align)
+            continue;
+        const size_t resume = (page - maxl + align - 1) / align * align;
+        if (begin > from)
+            fn(from, min(begin, starts));
+        skipped += min(resume, starts) - min(begin, starts);
+        from = resume;
+    }
+    if (from < starts)
+        fn(from, starts);
+}
+
+void Substrings::process_wide(DataView data, bool filter, bool last)
+{
+    // Printable UTF-16LE runs are decoded into wdata and counted there in characters.
+    // Runs of both byte phases never share a byte, so the reserve below is never exceeded
+    // and the keys referring to wdata stay valid. Unless the data is the last of its slices,
+    // the windows starting in the overlap of the next slice are left to that one.
+    const size_t limit = (last || data.length() < maxl * 2) ? data.length() : data.length() - maxl * 2;
+    wdata.clear();
+    wdata.reserve(data.length() / 2 + 1);
+    wruns.clear();
+    for (size_t phase : { 0u, 1u })
+    {
+        if (data.length() <= phase)
+            break;
+        DataView units = data.substr(phase);
+        simd::wide_printable(units, wbits);
+        simd::for_each_run(wbits, units.length() / 2, minl,
+            [&](size_t begin, size_t length)
+            {
+                // windows of the run starting below limit, each character takes two bytes
+                const size_t below = (limit > phase) ? (limit - phase + 1) / 2 : 0;
+                const size_t starts = min(length - minl + 1, (below > begin) ? below - begin : 0);
+                if (!starts)
+                    return;
+                const size_t from = wdata.length();
+                wruns.push_back({ from, phase + begin * 2 });
+                for (size_t i = begin; i < begin + length; ++i)
+                    wdata.push_back(units[i * 2]);
+                DataView text = DataView(wdata).substr(from, length);
+                scan(text, starts, false, filter, [this](DataView subd) { keys[subd]++; });
+            });
+    }
+}
+
+template<typename Word>
+void Substrings::count_words(WordCounters<Word>& words, DataView subd)
+{
+    if (subd.length() <= words.MAX_LENGTH)
+        words.add(subd.data(), subd.length() / words.WORD_SIZE, static_cast<size_t>(subd.data() - origin.data()));
+    else
+        keys[subd]++;
+}
+
+void Substrings::fold_words()
+{
+    // the views point into the word tables, which stay untouched until the next process()
+    auto fold = [this](DataView key, size_t value, size_t) { keys[key] += value; };
+    fixed.for_each(fold);
+    words32.for_each(fold);
+    words64.for_each(fold);
+}
+
+size_t Substrings::locate(DataView key) const
+{
+    // position within the processed data of the occurrence the key refers to
+    if (key.data() >= origin.data() && key.data() < origin.data() + origin.length())
+        return static_cast<size_t>(key.data() - origin.data());
+    if (!wruns.empty() && key.data() >= wdata.data() && key.data() < wdata.data() + wdata.length()) {
+        const auto at = static_cast<size_t>(key.data() - wdata.data());
+        auto run = prev(ranges::upper_bound(wruns, at, {}, &pair<size_t, size_t>::first));
+        return run->second + (at - run->first) * 2;
     }
+    return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-SubstringsConcurrent::SubstringsConcurrent(size_t minl, size_t maxl, unsigned to_skip, unsigned drop_volume, size_t amount) :
-    Substrings(minl, maxl, to_skip)
+SubstringsConcurrent::SubstringsConcurrent(size_t minl, size_t maxl, unsigned to_skip, unsigned drop_volume, size_t amount, unsigned align, size_t memory) :
+    Substrings(minl, maxl, to_skip, align)
+    , tallied(false)
+    , offsets(false)
+    , shared_pool(false)
+    , placement(Placement::Oversubscribed)
+    , log(&cerr)
+    , peek_every(0)
     , amount(amount)
     , drop_volume(drop_volume)
+    , drop_limit(drop_volume)
     , trunc_cnt(0)
+    , skipped_holes(0)
+    , skipped_fill(0)
+    , diffing(false)
+    , consumed(0)
 {
-    ram_size = get_ram_size();
+    ram_size = memory ? memory : get_memory_limit();
 }
 
 SubstringsConcurrent::~SubstringsConcurrent() {}
 
-generator_ns::generator<ResultEl> SubstringsConcurrent::top_c()
+atomic<bool> SubstringsConcurrent::peek_requested = false;
+
+void SubstringsConcurrent::set_peek(Peek fn, unsigned every)
+{
+    peek = move(fn);
+    peek_every = every;
+}
+
+Result SubstringsConcurrent::provisional()
 {
-    top_w(result, rkeys, amount);
+    Result candidates;
+    for (auto& [key, entry] : tracker.snapshot())
+        candidates.emplace_back(move(key), Tally(entry.first, entry.second));
+    return filter_close(move(candidates));
+}
+
+Result SubstringsConcurrent::filter_close(Result&& candidates) const
+{
+    // drops the keys too similar to a better one, as top_c does
     Matcher matcher(MATCH_RATIO);
-    for (const auto& i :
-        result
-        | views::filter(
-            [&](const auto& i)
+    Result shown;
+    for (auto& i : candidates)
+    {
+        if (shown.size() >= amount)
+            break;
+        bool matchs = matcher.get_close_matches(i.first);
+        matcher.append(i.first);
+        if (!matchs)
+            shown.push_back(move(i));
+    }
+    return shown;
+}
+
+void SubstringsConcurrent::share_executor(shared_ptr<tf::Executor> pool)
+{
+    executor = move(pool);
+    shared_pool = true;
+}
+
+void SubstringsConcurrent::share_budget(shared_ptr<MemoryBudget> budget)
+{
+    shared_budget = move(budget);
+}
+
+void SubstringsConcurrent::trim(size_t keep)
+{
+    // the workers past the first ones fitting in keep give up their tables and buffers
+    size_t sum = 0;
+    for (size_t worker = 0; worker < contexts.size(); ++worker)
+    {
+        sum += buffers[worker].capacity() + (contexts[worker] ? contexts[worker]->footprint() : 0);
+        if (sum > keep) {
+            contexts[worker].reset();
+            Buffer().swap(buffers[worker]);
+        }
+    }
+    hugepages::release();
+}
+
+void SubstringsConcurrent::reset()
+{
+    rkeys.clear();
+    rtallies.clear();
+    consumed = 0;
+}
+
+void SubstringsConcurrent::use_tallies(bool on)
+{
+    // the keys counted so far move to the other table, a count taken without an offset stays without one
+    if (on == tallied)
+        return;
+    if (on) {
+        rtallies.reserve(rkeys.size());
+        for (const auto& [key, value] : rkeys)
+            rtallies.emplace(key, Tally(value));
+        ReducedKeys().swap(rkeys);
+    }
+    else {
+        rkeys.reserve(rtallies.size());
+        for (const auto& [key, value] : rtallies)
+            rkeys.emplace(key, value.count);
+        ReducedTallies().swap(rtallies);
+    }
+    tallied = on;
+}
+
+// binds every worker of a pool to its cpu as it starts
+class Pinning final : public tf::WorkerInterface
+{
+protected:
+    vector<CpuInfo> cpus;
+public:
+    explicit Pinning(vector<CpuInfo> cpus) : cpus(move(cpus)) {}
+    void scheduler_prologue(tf::Worker& worker) override { pin_thread(cpus[worker.id() % cpus.size()].cpu); }
+    void scheduler_epilogue(tf::Worker&, exception_ptr) override {}
+};
+
+void SubstringsConcurrent::set_placement(Placement how)
+{
+    placement = how;
+    cpus.clear();
+    executor.reset();
+    if (how != Placement::Cores && how != Placement::Threads)
+        return;
+    auto topology = get_cpu_topology();
+    ranges::sort(topology, {}, [](const CpuInfo& c) { return tuple(c.package, c.core, c.cpu); });
+    for (const auto& c : topology)
+    {
+        // the siblings of a core stay idle under one worker per core
+        if (how == Placement::Cores && !cpus.empty() && cpus.back().package == c.package && cpus.back().core == c.core)
+            continue;
+        cpus.push_back(c);
+    }
+}
+
+unsigned SubstringsConcurrent::pool_limit() const
+{
+    if (pinned())
+        return static_cast<unsigned>(cpus.size());
+    const unsigned hw = thread::hardware_concurrency();
+    return (placement == Placement::Oversubscribed) ? max(hw * 2, 1u) : max(hw, 1u);
+}
+
+tf::Executor& SubstringsConcurrent::get_executor(unsigned pool_size)
+{
+    // 0 takes whatever pool the last pass ran on, a shared pool is taken as it is
+    if (shared_pool)
+        return *executor;
+    if (!pool_size)
+        pool_size = executor ? static_cast<unsigned>(executor->num_workers()) : max(thread::hardware_concurrency(), 1u);
+    if (!executor || executor->num_workers() != pool_size)
+        executor = pinned() ? make_shared<tf::Executor>(pool_size, make_shared<Pinning>(cpus)) : make_shared<tf::Executor>(pool_size);
+    return *executor;
+}
+
+template<typename Score>
+void SubstringsConcurrent::select(Score score, bool consume)
+{
+    // Every submap keeps its best candidates in a buffer cut back with nth_element whenever it
+    // doubles, then the candidates of all the submaps are merged. The order is the one of top_w.
+    result.clear();
+    with_rkeys([&](auto& rkeys)
+        {
+            using Candidate = const typename remove_cvref_t<decltype(rkeys)>::value_type*;
+            const size_t want = min(rkeys.size(), calc_reserve());
+            if (!want)
+                return;
+            auto better = [&](Candidate l, Candidate r)
             {
-                bool matchs = matcher.get_close_matches(i.first);
-                matcher.append(i.first);
-                return !matchs;
+                const auto ls = score(l->second), rs = score(r->second);
+                return (ls == rs) ? l->first > r->first : ls > rs;
+            };
+            vector<vector<Candidate>> shards(rkeys.subcnt());
+            tf::Taskflow taskflow;
+            taskflow.for_each_index(size_t(0), shards.size(), size_t(1),
+                [&](size_t i)
+                {
+                    auto& best = shards[i];
+                    rkeys.with_submap(i,
+                        [&](const auto& submap)
+                        {
+                            for (const auto& el : submap)
+                            {
+                                best.push_back(&el);
+                                if (best.size() >= want * 2) {
+                                    nth_element(best.begin(), best.begin() + want, best.end(), better);
+                                    best.resize(want);
+                                }
+                            }
+                        });
+                });
+            get_executor().run(taskflow).get();
+
+            vector<Candidate> merged;
+            for (const auto& best : shards)
+                merged.insert(merged.end(), best.begin(), best.end());
+            const size_t count = min(merged.size(), want);
+            partial_sort(merged.begin(), merged.begin() + count, merged.end(), better);
+            result.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (consume) {
+                    auto node = rkeys.extract(rkeys.find(merged[i]->first));
+                    result.emplace_back(move(node.key()), tally_of(node.mapped()));
+                }
+                else
+                    result.emplace_back(merged[i]->first, tally_of(merged[i]->second));
             }
-        )
-        | views::take(amount))
+        });
+}
+
+generator_ns::generator<ResultEl> SubstringsConcurrent::top_c(bool relative, bool consume)
+{
+    if (!diffing)
+        select([](const auto& v) { return count_of(v); }, consume);
+    else if (relative)
+        select([](const auto& v) { return (count_of(v) + 1.0) / (baseline_of(v) + 1.0); }, consume);
+    else
+        select([](const auto& v) { return static_cast<int64_t>(count_of(v) - baseline_of(v)); }, consume);
+    if (diffing)
+        erase_if(result, [](const auto& i) { return i.second.count <= i.second.baseline; });
+    for (auto& i : filter_close(move(result)))
         co_yield i;
 }
 
-void SubstringsConcurrent::process_c(const string& path, bool ascii, bool filter, size_t scale)
+void SubstringsConcurrent::process_c(const Segments& input, bool ascii, bool filter, size_t scale, bool wide)
+{
+    diffing = false;
+    process_sources({ &input }, ascii, filter, scale, wide);
+}
+
+void SubstringsConcurrent::process_diff(const Segments& baseline, const Segments& input, bool ascii, bool filter, size_t scale, bool wide)
+{
+    diffing = true;
+    process_sources({ &baseline, &input }, ascii, filter, scale, wide);
+}
+
+bool SubstringsConcurrent::process_more(const Segments& input, bool ascii, bool filter, size_t scale, bool wide)
+{
+    if (input.compressed())
+        throw runtime_error("A compressed input can't be followed");
+    const auto size = input.file_size();
+    if (size < consumed) {
+        // truncated or replaced, start over
+        reset();
+    }
+    if (size == consumed)
+        return false;
+    // resume at the first start the previous pass left uncounted, wide runs are re-read as the slices do
+    size_t from = 0;
+    if (wide)
+        from = consumed - min(consumed, maxl * 2);
+    else if (consumed > maxl)
+        from = (consumed - maxl + align - 1) / align * align;
+    diffing = false;
+    process_sources({ &input }, ascii, filter, scale, wide, from, true);
+    consumed = size;
+    return true;
+}
+
+uint64_t SubstringsConcurrent::checkpoint_tag(bool ascii, bool filter, bool wide) const
+{
+    // a checkpoint is only valid for the settings the keys were counted with
+    uint64_t tag = CHECKPOINT_MAGIC;
+    for (uint64_t v : { uint64_t(minl), uint64_t(maxl), uint64_t(to_skip), uint64_t(align), uint64_t(ascii), uint64_t(filter), uint64_t(wide),
+        uint64_t(bit_cast<uint32_t>(prepass.min_entropy())), uint64_t(bit_cast<uint32_t>(prepass.max_entropy())) })
+        tag = (tag ^ v) * 0x100000001b3ull;
+    return tag;
+}
+
+void SubstringsConcurrent::save_checkpoint(const string& path, bool ascii, bool filter, bool wide) const
+{
+    // written aside and renamed, so an interrupted save leaves the previous checkpoint intact
+    const auto temp = path + ".tmp";
+    {
+        ofstream f(temp, ios::out | ios::binary | ios::trunc);
+        auto put = [&](uint64_t v) { f.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+        put(checkpoint_tag(ascii, filter, wide));
+        put(consumed);
+        with_rkeys([&](const auto& rkeys)
+            {
+                put(rkeys.size());
+                for (const auto& [key, value] : rkeys)
+                {
+                    put(key.length());
+                    f.write(key.data(), key.length());
+                    put(count_of(value));
+                    put(offset_of(value));
+                }
+            });
+        if (!f)
+            throw runtime_error(format("Cannot write checkpoint {}", temp));
+    }
+    filesystem::rename(temp, path);
+}
+
+bool SubstringsConcurrent::load_checkpoint(const string& path, bool ascii, bool filter, bool wide)
+{
+    ifstream f(path, ios::in | ios::binary);
+    auto get = [&]() { uint64_t v = 0; f.read(reinterpret_cast<char*>(&v), sizeof(v)); return v; };
+    if (!f || get() != checkpoint_tag(ascii, filter, wide))
+        return false;
+    const auto done = get();
+    auto count = get();
+    // lengths are checked before anything is allocated, a corrupt checkpoint is rejected instead
+    const size_t longest = wide ? maxl * 2 : maxl;
+    if (count > filesystem::file_size(path) / (3 * sizeof(uint64_t)))
+        return false;
+    ReducedTallies loaded;
+    loaded.reserve(count);
+    bool located = false;
+    while (f && count--)
+    {
+        const auto length = get();
+        if (length > longest)
+            return false;
+        Data key(length, '\0');
+        f.read(key.data(), key.length());
+        const auto value = get(), offset = get();
+        loaded[key] = Tally(value, offset);
+        located = located || offset;
+    }
+    if (!f)
+        return false;
+    // the keys keep their offsets if the checkpoint has any
+    rkeys.clear();
+    rtallies.swap(loaded);
+    tallied = true;
+    use_tallies(located || offsets);
+    consumed = done;
+    return true;
+}
+
+void SubstringsConcurrent::process_sources(const vector<const Segments*>& sources, bool ascii, bool filter, size_t scale, bool wide, size_t from,
+    bool open_end)
 {
     TimeIt time_it("Calculation time is");
 
+    drop_volume = drop_limit;
+    use_tallies(diffing || offsets || ranges::any_of(sources, &Segments::mapped));
+
+    // Frames of a compressed input are sliced like a file if they all state their sizes, the whole
+    // input is in the pass and a window can start anywhere. Anything else compressed is one stream.
+    auto by_frames = [&](const Segments& input)
+    {
+        const auto& frames = input.frame_list();
+        const auto& items = input.list();
+        return align == 1 && !wide && frames.size() > 1 && items.size() == 1 && items[0].offset == 0 && items[0].length == input.file_size()
+            && ranges::all_of(frames, [](const Frame& frame) { return frame.size <= MAX_FRAME_SLICE; });
+    };
+    vector<Extents> extents(sources.size());
+    vector<unsigned> streams;
+    size_t total = 0, volume = 0;
+    for (size_t si = 0; si < sources.size(); ++si)
+    {
+        const auto& input = *sources[si];
+        const auto fsize = input.file_size();
+        if (input.compressed()) {
+            const bool framed = by_frames(input);
+            *log << format("Decompressing {} from {}, {}", input.file(), codec_name(input.compression()),
+                framed ? format("{} frames in parallel", input.frame_list().size()) : string("a single stream")) << endl;
+            if (!framed)
+                streams.push_back(static_cast<unsigned>(si));
+            else
+                extents[si].push_back({ 0, fsize });
+            // the size of a stream is only known once it is read, the compressed size stands in
+            const size_t known = framed ? fsize : (fsize == UNKNOWN_SIZE ? filesystem::file_size(input.file()) : fsize);
+            total += known;
+            volume += known;
+            continue;
+        }
+        // under the entropy filter holes cannot yield anything, so only data extents are read
+        const auto data = (filter && !input.in_memory()) ? get_data_extents(input.file(), fsize) : Extents{ { 0, fsize } };
+        size_t mapped = 0;
+        for (const auto& seg : input.list())
+        {
+            const size_t lo = max(seg.offset, from), hi = seg.offset + seg.length;
+            if (lo >= hi)
+                continue;
+            mapped += hi - lo;
+            for (auto extent : pad_extents(data, seg.offset, hi))
+            {
+                if (extent.offset + extent.length <= lo)
+                    continue;
+                if (extent.offset < lo) {
+                    extent.length -= lo - extent.offset;
+                    extent.offset = lo;
+                }
+                extents[si].push_back(extent);
+                volume += extent.length;
+            }
+        }
+        total += mapped;
+        if (input.mapped())
+            *log << format("Scanning {} bytes in {} segments of {}", mapped, input.list().size(), input.file()) << endl;
+    }
+    skipped_holes = total - volume;
+    skipped_fill = 0;
+
+    // the slices don't depend on the placement, only the number of workers running them does
     const unsigned procs_count = max(thread::hardware_concurrency() * 2, 1u);
-    const auto estms = tune_on_size(path, procs_count, static_cast<unsigned>(scale));
+    const auto estms = tune_on_size(volume, procs_count, static_cast<unsigned>(scale));
+    // Wide strings take two bytes per character. A slice counts the aligned starts at least a window
+    // before its end, so the next one begins at the first aligned start that is left.
+    const size_t window = wide ? maxl * 2 : maxl;
+    const size_t overlap = wide ? window : window / align * align;
+    vector<Slice> slices;
+    for (size_t si = 0; si < sources.size(); ++si)
+    {
+        if (!sources[si]->compressed())
+            slice(slices, extents[si], estms.dv, overlap, static_cast<unsigned>(si));
+        else if (!extents[si].empty())
+            slice_frames(slices, sources[si]->frame_list(), estms.dv, static_cast<unsigned>(si));
+    }
+    // the input grows, the next pass resumes at the overlap of its last slice
+    if (open_end && !slices.empty())
+        slices.back().last = false;
 
-    ProgressIndicator indicator(estms.psize);
+    // a stream advances the progress by its share of the compressed file read so far
+    ProgressIndicator indicator(slices.size() + streams.size() * STREAM_STEPS, *log);
     mutex iomtx, accmtx;
-    tf::Executor executor(estms.pool_size);
+    auto& pool = get_executor(min(estms.pool_size, pool_limit()));
+    // a budget shared with other instances counts what their passes hold as well
+    MemoryBudget own(shared_budget ? 0 : ram_size ? ram_size : numeric_limits<size_t>::max());
+    auto& budget = shared_budget ? *shared_budget : own;
+    // Every worker keeps its own counter and read buffer for all the slices it runs. The tables
+    // are reserved for the most keys a slice has produced so far instead of growing by rehashes.
+    // What a worker keeps stays charged between its slices, only a lease for more is taken.
+    contexts.resize(pool.num_workers());
+    buffers.resize(pool.num_workers());
+    vector<MemoryBudget::Charge> held;
+    held.reserve(pool.num_workers());
+    for (size_t worker = 0; worker < pool.num_workers(); ++worker)
+        held.emplace_back(budget, buffers[worker].capacity() + (contexts[worker] ? contexts[worker]->footprint() : 0));
+    atomic<size_t> learned = 0;
+    size_t observed = 0;
+    atomic<size_t> ratio = task_model();
+    MemoryBudget::Charge kept(budget, rkeys_memory());
+    // a diff has no meaningful order until both inputs are merged
+    tracker.reset(diffing ? 0 : calc_reserve());
+    mutex peekmtx;
+    size_t merged = 0;
+    const size_t peek_mark = max<size_t>(slices.size() * peek_every / 100, 1u);
+    const unsigned workers = share ? clamp(share(), 1u, static_cast<unsigned>(pool.num_workers())) : static_cast<unsigned>(pool.num_workers());
     tf::Taskflow taskflow;
 
     indicator.display(ProgressIndicator::Phase::Begin);
 
-    auto slci = slice(estms, maxl);
-    taskflow.for_each(slci.begin(), slci.end(),
-        [&, ascii](const pair<size_t, pair<size_t, size_t>>& rnginfo)
+    auto logged = [&](auto&& task)
+    {
+        try
         {
-            const auto& [ino, rng] = rnginfo;
-            try
+            task();
+        }
+        catch (const exception& ex) {
+            *log << "Exception occured: " << ex.what() << endl;
+            throw;
+        }
+        catch (...) {
+            *log << "Unknown exception occured!" << endl;
+            throw;
+        }
+    };
+    // the lease of a slice covers what its worker needs beyond what it already holds
+    auto lease_for = [&](const Slice& rng)
+    {
+        const size_t need = rng.length / 1024 * ratio + ratio, worker = static_cast<size_t>(pool.this_worker_id());
+        return need - min(need, held[worker].size());
+    };
+    // counts the data of a slice under its lease, then charges what the worker keeps in place of the lease
+    auto count_data = [&, ascii, wide](const Slice& rng, DataView tdata, MemoryBudget::Lease& lease)
+    {
+        const auto worker = static_cast<size_t>(pool.this_worker_id());
+        if (!contexts[worker])
+            contexts[worker] = make_unique<SubstringsConcurrent>(minl, maxl, to_skip, drop_volume, amount, align, ram_size);
+        auto& subs = *contexts[worker];
+        subs.drop_volume = drop_volume;
+        subs.set_entropy(prepass.min_entropy(), prepass.max_entropy());
+        subs.expect(learned);
+        subs.process(tdata, ascii, filter, wide, rng.last);
+        const size_t footprint = buffers[worker].capacity() + subs.footprint();
+        held[worker].resize(footprint);
+        lease.resize(0);
+
+        bool report = false, shed = false;
+        {
+            scoped_lock lock(accmtx);
+            // later leases follow the largest footprint seen so far instead of the model
+            observed = max(observed, footprint / (rng.length / 1024 + 1));
+            learned = max<size_t>(learned, subs.keys.size() + subs.fixed.size());
+            ratio = observed * 5 / 4;
+            with_rkeys([&](auto& rkeys) { subs.accumulate(rkeys, rng.offset, diffing && rng.source == 0, &tracker); });
+            skipped_fill += subs.skipped;
+            kept.resize(rkeys_memory());
+            const bool pressed = budget.pressed();
+            if (pressed || (drop_volume && ++trunc_cnt >= TRUNC_EVERY)) {
+                trunc_cnt = 0;
+                truncate(pressed);
+                kept.resize(rkeys_memory());
+            }
+            shed = pressed;
+            report = peek && ((peek_every && ++merged % peek_mark == 0) || peek_requested.exchange(false));
+        }
+        if (shed) {
+            // under pressure a worker gives up its tables and buffer once merged, the next slice builds them anew
+            contexts[worker].reset();
+            Buffer().swap(buffers[worker]);
+            held[worker].resize(0);
+        }
+        if (report) {
+            unique_lock lock(peekmtx, try_to_lock); // one provisional at a time, a busy one is enough
+            if (lock)
+                peek(provisional());
+        }
+        indicator.update(rng.ino);
+        indicator.display();
+    };
+    auto count_slice = [&](const Slice& rng)
+    {
+        logged([&]
+            {
+                // waits while the running tasks and the table leave no room for this slice
+                MemoryBudget::Lease lease(budget, lease_for(rng));
+                const auto& source = *sources[rng.source];
+                auto& buffer = buffers[static_cast<size_t>(pool.this_worker_id())];
+                DataView tdata;
+                if (source.in_memory())
+                    tdata = source.memory().substr(rng.offset, rng.length); // counted in place
+                else if (source.compressed()) {
+                    // the frames of the slice and a window into the frames after it
+                    const auto& frames = source.frame_list();
+                    const auto first = ranges::lower_bound(frames, rng.offset, {}, &Frame::content);
+                    buffer.resize(rng.length + window);
+                    buffer.resize(Decompressor::open(source.file(), source.compression(), first->offset)->read(buffer.data(), buffer.size()));
+                    if (buffer.size() < rng.length)
+                        throw runtime_error(format("{} is shorter than its frames state", source.file()));
+                    tdata = DataView(buffer.data(), buffer.size());
+                }
+                else {
+                    buffer.resize(rng.length);
+                    {
+                        scoped_lock lock(iomtx); // make file access sequential
+                        ifstream f(source.file(), ios::in | ios::binary);
+                        f.seekg(rng.offset);
+                        f.read(buffer.data(), rng.length);
+                    }
+                    tdata = DataView(buffer.data(), buffer.size());
+                }
+                count_data(rng, tdata, lease);
+            });
+    };
+    // the next slice of every block, the taskflow only runs once the blocks are set up
+    vector<atomic<size_t>> next(pinned() ? workers : 0u);
+    vector<size_t> ends(next.size());
+    if (share)
+        run_shared(slices.size(), [&](size_t i) { count_slice(slices[i]); });
+    else if (pinned()) {
+        // Each lane runs a block of adjacent slices, so the slices a worker takes in turn are neighbours in the
+        // input, and goes on with the rest of the other blocks once its own is done.
+        for (unsigned lane = 0; lane < workers; ++lane)
+        {
+            next[lane] = slices.size() * lane / workers;
+            ends[lane] = slices.size() * (lane + 1) / workers;
+        }
+        taskflow.for_each_index(0u, workers, 1u,
+            [&](unsigned lane)
             {
-                string tdata(rng.second, '\0');
+                for (unsigned k = 0; k < workers; ++k)
                 {
-                    scoped_lock lock(iomtx); // make file access sequential
-                    ifstream f(path, ios::in | ios::binary);
-                    f.seekg(rng.first);
-                    f.read(tdata.data(), rng.second);
+                    const unsigned block = (lane + k) % workers;
+                    for (size_t i = next[block]++; i < ends[block]; i = next[block]++)
+                        count_slice(slices[i]);
                 }
+            });
+    }
+    else
+        taskflow.for_each(slices.begin(), slices.end(), count_slice);
 
-                SubstringsConcurrent subs(minl, maxl, to_skip, drop_volume, amount);
-                subs.process(tdata, ascii, filter);
+    pool.run(taskflow).get();
 
-                {
-                    scoped_lock lock(accmtx);
-                    subs.accumulate(rkeys);
-                    if (drop_volume && ++trunc_cnt >= TRUNC_EVERY) {
-                        trunc_cnt = 0;
-                        truncate();
-                    }
+    for (size_t n = 0; n < streams.size(); ++n)
+        count_stream(*sources[streams[n]], streams[n], slices.size() + n * STREAM_STEPS, estms.dv, overlap, workers, budget,
+            [&](const Slice& rng, DataView tdata)
+            {
+                logged([&]
+                    {
+                        MemoryBudget::Lease lease(budget, lease_for(rng));
+                        count_data(rng, tdata, lease); // the chunk buffers are charged as a whole
+                    });
+            });
+
+    indicator.display(ProgressIndicator::Phase::End);
+    hugepages::release(); // the blocks kept for the next chunk aren't in the budget
+    if (skipped_holes || skipped_fill)
+        *log << format("Skipped {} bytes: {} in holes, {} in fill pages", skipped_holes + skipped_fill, skipped_holes, skipped_fill) << endl;
+    *log << format("Peak memory {} MiB accounted, {} MiB resident of {} MiB budget",
+        budget.get_peak() >> 20, get_peak_rss() >> 20, budget.get_limit() >> 20) << endl;
+}
+
+void SubstringsConcurrent::run_shared(size_t count, const function<void(size_t)>& fn)
+{
+    // Runs fn for every index on lanes of the pool, at most share() of them at a time. A lane takes the
+    // next index when it is done with one, and asks for the share again before: above it the lane leaves,
+    // below it the lane starts more. So a pass gives workers back as others start and takes them again
+    // as they finish. The first failure stops the lanes and is rethrown here.
+    auto& pool = get_executor();
+    atomic<size_t> next = 0;
+    unsigned running = 0;
+    exception_ptr failed;
+    mutex lanemtx;
+    condition_variable idle;
+    function<void()> lane = [&]
+    {
+        for (;;)
+        {
+            unsigned more = 0;
+            {
+                scoped_lock lock(lanemtx);
+                const unsigned limit = max(share(), 1u);
+                const size_t left = (failed || next >= count) ? 0 : count - next;
+                if (!left || running > limit) {
+                    if (--running == 0)
+                        idle.notify_all();
+                    return;
                 }
-                indicator.update(ino);
-                indicator.display();
+                more = static_cast<unsigned>(min<size_t>(limit - running, left - 1));
+                running += more;
             }
-            catch (const exception& ex) {
-                cerr << "Exception occured: " << ex.what() << endl;
-                throw;
+            for (; more; --more)
+                pool.silent_async([&] { lane(); });
+            const size_t i = next++;
+            if (i >= count)
+                continue;
+            try
+            {
+                fn(i);
             }
             catch (...) {
-                cerr << "Unknown exception occured!" << endl;
-                throw;
+                scoped_lock lock(lanemtx);
+                if (!failed)
+                    failed = current_exception();
             }
-        });
-
-    executor.run(taskflow).get();
-
-    indicator.display(ProgressIndicator::Phase::End);
-
+        }
+    };
+    if (!count)
+        return;
+    {
+        scoped_lock lock(lanemtx);
+        running = 1;
+    }
+    pool.silent_async([&] { lane(); });
+    unique_lock lock(lanemtx);
+    idle.wait(lock, [&] { return running == 0; });
+    if (failed)
+        rethrow_exception(failed);
 }
 
-void SubstringsConcurrent::accumulate(ReducedKeys& rkeys)
+void SubstringsConcurrent::count_stream(const Segments& input, unsigned source, size_t ino, size_t dv, size_t overlap, unsigned workers,
+    MemoryBudget& budget, const function<void(const Slice&, DataView)>& count)
 {
-    for (const auto& [key, value] : keys)
+    // A single reader decompresses the stream into chunks, each starting with the overlap of the one
+    // before, and the workers count them as they come. Only a fixed set of chunk buffers is in flight.
+    if (input.list().empty())
+        return;
+    const auto& seg = input.list().front(); // a compressed input is flat
+    const size_t lo = seg.offset, hi = (seg.length > UNKNOWN_SIZE - lo) ? UNKNOWN_SIZE : lo + seg.length;
+    const size_t step = max<size_t>(min<size_t>(dv, STREAM_CHUNK) / align * align, align); // chunk starts stay aligned
+    auto& pool = get_executor();
+    vector<Buffer> chunks(workers + CHUNKS_AHEAD);
+    vector<Slice> placed(chunks.size());
+    ChunkQueue queue(chunks.size());
+    const MemoryBudget::Charge reserved(budget, chunks.size() * (step + overlap));
+    tf::Taskflow taskflow;
+    taskflow.for_each_index(0u, workers, 1u,
+        [&](unsigned lane)
+        {
+            for (;;)
+            {
+                // a lane above the share leaves, the first one stays to drain the stream
+                if (lane && share && lane >= share())
+                    return;
+                const size_t i = queue.take();
+                if (i == ChunkQueue::NONE)
+                    return;
+                try
+                {
+                    count(placed[i], DataView(chunks[i].data(), chunks[i].size()));
+                }
+                catch (...) {
+                    queue.fail();
+                    throw;
+                }
+                queue.release(i);
+            }
+        });
+    auto running = pool.run(taskflow);
+    try
     {
-        if (value > drop_volume)
-            rkeys[key] += value;
+        auto reader = Decompressor::open(input.file(), input.compression());
+        const size_t csize = max<size_t>(filesystem::file_size(input.file()), 1u);
+        size_t at = 0;
+        // the bytes ahead of the range are decompressed only to be dropped
+        for (auto& scratch = chunks.front(); at < lo;)
+        {
+            scratch.resize(min(step, lo - at));
+            const size_t got = reader->read(scratch.data(), scratch.size());
+            at += got;
+            if (got < scratch.size())
+                break;
+        }
+        string carry;
+        while (at < hi)
+        {
+            const size_t i = queue.acquire();
+            if (i == ChunkQueue::NONE)
+                break;
+            auto& chunk = chunks[i];
+            const size_t want = min(step, hi - at);
+            chunk.resize(carry.size() + want);
+            ranges::copy(carry, chunk.begin());
+            const size_t got = reader->read(chunk.data() + carry.size(), want);
+            chunk.resize(carry.size() + got);
+            if (chunk.empty()) {
+                queue.release(i);
+                break;
+            }
+            // a stream ending right after a chunk leaves its overlap to a last chunk of its own
+            const bool last = got < want || at + got >= hi;
+            placed[i] = { ino + min(reader->position() * STREAM_STEPS / csize, STREAM_STEPS), source, at - carry.size(), chunk.size(), last };
+            at += got;
+            carry.assign(chunk.end() - min(chunk.size(), overlap), chunk.end());
+            queue.post(i);
+            if (last)
+                break;
+        }
+    }
+    catch (...) {
+        queue.close();
+        running.wait();
+        throw;
     }
+    queue.close();
+    running.get();
 }
 
-SubstringsConcurrent::Estimations SubstringsConcurrent::tune_on_size(const string& path, unsigned pool_size, unsigned scale)
+template<typename Table>
+void SubstringsConcurrent::accumulate(Table& rkeys, size_t base, bool to_baseline, TopTracker* tracker)
 {
-    const auto fsize = filesystem::file_size(path);
-    if (fsize / pool_size <= maxl) {
+    constexpr bool located = is_same_v<Table, ReducedTallies>;
+    auto merge = [&](DataView key, size_t value, size_t pos)
+    {
+        if (value > drop_volume) {
+            auto& tally = rkeys[key];
+            if constexpr (located) {
+                if (to_baseline)
+                    tally.baseline += value;
+                else {
+                    if (tally.count == 0)
+                        tally.offset = base + pos;
+                    tally.count += value;
+                    if (tracker && tracker->wants(tally.count))
+                        tracker->offer(key, tally.count, tally.offset);
+                }
+            }
+            else {
+                tally += value;
+                if (tracker && tracker->wants(tally))
+                    tracker->offer(key, tally, 0);
+            }
+        }
+    };
+    for (const auto& [key, value] : keys)
+        merge(key, value, located ? locate(key) : 0);
+    fixed.for_each(merge);
+    words32.for_each(merge);
+    words64.for_each(merge);
+}
+
+SubstringsConcurrent::Estimations SubstringsConcurrent::tune_on_size(size_t size, unsigned pool_size, unsigned scale)
+{
+    if (size / pool_size <= maxl) {
+        // a single small slice is counted exactly
         pool_size = 1;
         scale = 1;
+        drop_volume = 0;
     }
     else if (!scale) {
         if (ram_size) {
             auto ram = ram_size / WORK_MEM_DIV;
             scale = max(
                 DFLT_SCALE,
-                static_cast<unsigned>((fsize * (maxl - minl + 1) * (sizeof(WorkEl) * 5 / 4)) / (ram * to_skip))
+                static_cast<unsigned>((size * (maxl - minl + 1) * (sizeof(WorkEl) * 5 / 4)) / (ram * length_step() * align))
             );
         }
         else
             scale = pool_size;
     }
     size_t psize = static_cast<size_t>(pool_size) * scale;
-    size_t dv = fsize / psize;
+    size_t dv = size / psize;
     if (dv < maxl) {
-        psize = fsize / maxl;
+        psize = max<size_t>(size / maxl, 1u);
         dv = maxl;
         drop_volume = 0;
     }
-    size_t md = fsize % psize;
-    return { psize, dv, md, pool_size };
+    dv = max<size_t>(dv - dv % align, align); // keep every slice start aligned within the file
+    return { dv, pool_size };
 }
 
-void SubstringsConcurrent::truncate()
+Extents SubstringsConcurrent::pad_extents(const Extents& extents, size_t lo, size_t hi) const
 {
-    auto vol = calc_reserve();
-    auto sz = rkeys.size();
-    if (vol >= sz / 2 || sz < (ram_size / KEYS_MEM_DIV) / ((sizeof(ResultEl) * 5 / 4) + (minl + maxl) / 2))
-        return;
-    size_t minv = numeric_limits<size_t>::max();
-    size_t maxv = 0;
-    for (const auto& i : rkeys)
+    // Clips the extents to [lo, hi) and widens them by maxl there, as windows crossing
+    // the edge of a hole still have to be seen. Starts stay aligned relative to lo.
+    Extents padded;
+    for (const auto& [offset, length] : extents)
     {
-        if (i.second < minv)
-            minv = i.second;
-        if (i.second > maxv)
-            maxv = i.second;
+        if (offset + length <= lo || offset >= hi)
+            continue;
+        size_t begin = (offset > lo + maxl) ? offset - maxl : lo;
+        begin -= (begin - lo) % align;
+        const size_t end = min(offset + length + maxl, hi);
+        if (!padded.empty() && begin <= padded.back().offset + padded.back().length)
+            padded.back().length = end - padded.back().offset;
+        else
+            padded.push_back({ begin, end - begin });
     }
-    auto lbnd = (maxv - minv) / sz * (sz - vol) + minv;
+    return padded;
+}
 
-    // free up space within rkeys for new ones
-    erase_if(rkeys, [=](const auto& i) { return i.second <= lbnd; });
+void SubstringsConcurrent::truncate(bool pressed)
+{
+    // under budget pressure the table is reduced whatever its size, otherwise only once it outgrows its share
+    with_rkeys([&](auto& rkeys)
+        {
+            auto vol = calc_reserve();
+            auto sz = rkeys.size();
+            if (vol >= sz / 2 || (!pressed && sz < (ram_size / KEYS_MEM_DIV) / ((sizeof(*rkeys.begin()) * 5 / 4) + (minl + maxl) / 2)))
+                return;
+            size_t minv = numeric_limits<size_t>::max();
+            size_t maxv = 0;
+            // in a diff a key is kept for the larger of its two counts, so a baseline count is not lost before the input catches up
+            auto weight = [](const auto& v) { return max(count_of(v), baseline_of(v)); };
+            for (const auto& i : rkeys)
+            {
+                if (weight(i.second) < minv)
+                    minv = weight(i.second);
+                if (weight(i.second) > maxv)
+                    maxv = weight(i.second);
+            }
+            auto lbnd = (maxv - minv) / sz * (sz - vol) + minv;
+
+            // free up space within rkeys for new ones
+            erase_if(rkeys, [=](const auto& i) { return weight(i.second) <= lbnd; });
+            if (pressed)
+                rkeys.rehash(0); // hand the freed slots back to the budget
+        });
 }
@@ -37,7 +37,25 @@ namespace generator_ns = std::experimental;
 namespace generator_ns = std;
 #endif
 
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <iosfwd>
 #include <phmap.h>
+#include "WordKeys.hpp"
+#include "LengthTables.hpp"
+#include "Simd.hpp"
+#include "Prepass.hpp"
+#include "system.hpp"
+#include "Segments.hpp"
+#include "MemoryBudget.hpp"
+#include "TopTracker.hpp"
+#include "HugePages.hpp"
+
+namespace tf
+{
+    class Executor;
+}
 
 namespace substrings
 {
@@ -49,89 +67,308 @@ namespace substrings
     constexpr auto WORK_MEM_DIV = 3u;
     constexpr auto KEYS_MEM_DIV = 5u;
     constexpr auto DFLT_SCALE = 8u;
+    constexpr auto FILL_PAGE = 4096u;
+    // a compressed stream goes to the workers in chunks of at most this size, behind the chunks being counted
+    // up to CHUNKS_AHEAD more wait decompressed
+    constexpr auto STREAM_CHUNK = std::size_t(1) << 25;
+    constexpr auto CHUNKS_AHEAD = 2u;
+    constexpr auto STREAM_STEPS = std::size_t(100);
+    // frames above this size are read as a stream instead of in parallel
+    constexpr auto MAX_FRAME_SLICE = std::size_t(1) << 28;
+    constexpr auto CHECKPOINT_MAGIC = 0x31505343'42555353ull; // "SSUBCSP1"
+    // a block repeating four bytes has at most two bits of entropy, so it is safe to skip under a filter
+    // rejecting that much
+    constexpr auto FILL_ENT = 2.0f;
+    static_assert(MIN_ENT >= FILL_ENT);
+
+    // occurrences of a key and the file offset of one of them, baseline counts the occurrences in the
+    // reference input of a diff
+    struct Tally
+    {
+        std::size_t count, offset, baseline;
+        Tally(std::size_t count = 0, std::size_t offset = 0, std::size_t baseline = 0) : count(count), offset(offset), baseline(baseline) {}
+    };
 
     using Data = std::string;
     using DataView = std::string_view;
-    using Keys = phmap::flat_hash_map<DataView, std::size_t>;
+    template<typename K, typename V>
+    using Table = phmap::flat_hash_map<K, V, phmap::priv::hash_default_hash<K>, phmap::priv::hash_default_eq<K>,
+        HugePageAllocator<std::pair<const K, V>>>;
+    using Keys = Table<DataView, std::size_t>;
     using WorkEl = std::pair<DataView, std::size_t>;
-    using ResultEl = std::pair<Data, std::size_t>;
+    using ResultEl = std::pair<Data, Tally>;
     using Result = std::vector<ResultEl>;
-    using ReducedKeys = phmap::flat_hash_map<Data, std::size_t>;
+    // sharded, so the final selection can run over the submaps in parallel
+    template<typename V>
+    using Reduced = phmap::parallel_flat_hash_map<Data, V, phmap::priv::hash_default_hash<Data>, phmap::priv::hash_default_eq<Data>,
+        HugePageAllocator<std::pair<const Data, V>>>;
+    // a plain run keeps only the count of a key, a diff or a dump the whole tally
+    using ReducedKeys = Reduced<std::size_t>;
+    using ReducedTallies = Reduced<Tally>;
+    using Buffer = std::basic_string<char, std::char_traits<char>, HugePageAllocator<char>>;
+    using Extents = std::vector<FileExtent>;
+
+    // Probed lengths Min..Max in multiples of Step that get their own counting kernel
+    template<std::size_t Min, std::size_t Max, std::size_t Step>
+    struct LengthRange
+    {
+        static constexpr std::size_t MIN = Min, MAX = Max, STEP = Step;
+        static constexpr std::size_t FIRST = (Min + Step - 1) / Step * Step;
+        static constexpr std::size_t COUNT = (Max - FIRST) / Step + 1;
+        static_assert(FIRST >= MIN_FIXED && Max <= MAX_FIXED);
+    };
+    using Kernels = std::tuple<LengthRange<15, 30, 3>, LengthRange<8, 64, 8>>;
+
+    // How many workers a pass runs and where: two or one per logical cpu left to the OS, or one pinned
+    // to each physical core or to each logical cpu. The slices and the tables of a worker are the same
+    // under each, none is sized to the cache share of its cpu.
+    enum class Placement {
+        Oversubscribed,
+        Logical,
+        Cores,
+        Threads
+    };
+
+    struct Slice
+    {
+        std::size_t ino;
+        unsigned source;
+        std::size_t offset, length;
+        // no slice of the same data follows, so the windows in its overlap are counted here
+        bool last;
+    };
 
     class Substrings
     {
     protected:
         Data sdata;
+        DataView origin;
+        Data wdata;
+        std::vector<std::pair<std::size_t, std::size_t>> wruns;
+        simd::Bitmap wbits;
+        Prepass prepass;
         Keys keys;
+        LengthTables fixed;
+        WordCounters<std::uint32_t> words32;
+        WordCounters<std::uint64_t> words64;
         Result result;
         std::size_t minl, maxl;
         unsigned to_skip;
+        unsigned align;
+        std::vector<std::size_t> lengths;
+        std::size_t skipped;
+        std::size_t expected;
+        bool specialized;
     public:
-        Substrings(std::size_t minl, std::size_t maxl, unsigned to_skip);
+        Substrings(std::size_t minl, std::size_t maxl, unsigned to_skip, unsigned align = 1);
         virtual ~Substrings();
         void process_file(const std::string& path);
-        void process(DataView data, bool ascii = false, bool filter = true);
+        void process(DataView data, bool ascii = false, bool filter = true, bool wide = false, bool last = true);
+        // bytes held by the tables and scratch buffers of the last process()
+        std::size_t footprint() const;
+        // keys the next process() should have room for from the start
+        void expect(std::size_t count) { expected = count; }
+        // bounds of the entropy filter, MIN_ENT and MAX_ENT by default
+        void set_entropy(float lo, float hi) { prepass.set_entropy(lo, hi); }
+        // off forces the generic counting loop where a kernel exists
+        void use_kernels(bool on) { specialized = on; }
+        bool has_kernel() const;
+        // distinct keys counted by the last process()
+        std::size_t size() const { return keys.size() + fixed.size() + words32.size() + words64.size(); }
         auto top(std::size_t amount)
         {
+            fold_words();
             top_w(result, keys, amount);
             return std::ranges::subrange(result.begin(), result.begin() + amount); // for removing
         }
     protected:
-        static bool is_ascii(DataView data)
+        // aligned mode probes whole words only, so the alignment replaces the skip step
+        unsigned length_step() const
         {
-            return !std::ranges::any_of(data, [](std::uint8_t c) {return c > 127; });
+            return (align > 1) ? align : to_skip;
         }
         size_t calc_reserve(std::size_t amount) const
         {
-            return amount * maxl * (maxl - minl + 1) / to_skip;
+            return amount * maxl * (maxl - minl + 1) / length_step();
         }
-        void top_w(auto& result, const auto& keys, std::size_t amount)
+        template<typename Sink>
+        void scan(DataView data, std::size_t starts, bool ascii, bool filter, Sink&& sink);
+        void scan_lengths(DataView data, std::size_t starts, bool ascii, bool filter);
+        using Kernel = void (Substrings::*)(DataView, std::size_t);
+        Kernel find_kernel(bool ascii, bool filter) const;
+        template<typename Range, bool Ascii, bool Filter>
+        void kernel(DataView data, std::size_t starts);
+        void process_wide(DataView data, bool filter, bool last);
+        template<typename F>
+        void for_each_live(DataView data, std::size_t starts, F&& fn);
+        template<typename Word>
+        void count_words(WordCounters<Word>& words, DataView subd);
+        void fold_words();
+        std::size_t locate(DataView key) const;
+        static std::size_t count_of(std::size_t value) { return value; }
+        static std::size_t count_of(const Tally& value) { return value.count; }
+        static std::size_t offset_of(std::size_t) { return 0; }
+        static std::size_t offset_of(const Tally& value) { return value.offset; }
+        static std::size_t baseline_of(std::size_t) { return 0; }
+        static std::size_t baseline_of(const Tally& value) { return value.baseline; }
+        static Tally tally_of(std::size_t value) { return Tally(value); }
+        static const Tally& tally_of(const Tally& value) { return value; }
+        void top_w(auto& result, const auto& keys, std::size_t amount, auto score)
         {
             result.resize(std::min(keys.size(), calc_reserve(amount)));
             partial_sort_copy(
                 keys.begin(), keys.end(), result.begin(), result.end(),
-                [](auto& l, auto& r) { return (l.second == r.second) ? l.first > r.first : l.second > r.second; }
+                [&](auto& l, auto& r)
+                {
+                    const auto ls = score(l.second), rs = score(r.second);
+                    return (ls == rs) ? l.first > r.first : ls > rs;
+                }
             );
         }
+        void top_w(auto& result, const auto& keys, std::size_t amount)
+        {
+            top_w(result, keys, amount, [](const auto& value) { return count_of(value); });
+        }
     };
 
     class SubstringsConcurrent: public Substrings {
+    public:
+        using Peek = std::function<void(const Result&)>;
     protected:
         struct Estimations {
-            std::size_t psize, dv, md;
+            std::size_t dv;
             unsigned pool_size;
         };
 
         ReducedKeys rkeys;
+        // holds the keys instead of rkeys while tallied: in a diff, over a dump or with the offsets kept
+        ReducedTallies rtallies;
+        bool tallied, offsets;
+        std::shared_ptr<tf::Executor> executor;
+        bool shared_pool;
+        std::function<unsigned()> share;
+        Placement placement;
+        // the cpus of the pinned workers in the order of their ids, the cpus of a core next to each other
+        std::vector<CpuInfo> cpus;
+        // the counters and read buffers of the workers, kept warm from one pass to the next
+        std::vector<std::unique_ptr<SubstringsConcurrent>> contexts;
+        std::vector<Buffer> buffers;
+        std::ostream* log;
+        TopTracker tracker;
+        Peek peek;
+        unsigned peek_every;
+        static std::atomic<bool> peek_requested;
         std::size_t ram_size;
+        std::shared_ptr<MemoryBudget> shared_budget;
         std::size_t amount;
-        unsigned drop_volume;
+        unsigned drop_volume, drop_limit;
         unsigned trunc_cnt;
+        std::size_t skipped_holes, skipped_fill;
+        bool diffing;
+        std::size_t consumed;
     public:
-        SubstringsConcurrent(std::size_t minl, std::size_t maxl, unsigned to_skip, unsigned drop_volume, std::size_t amount);
+        // memory is the budget in bytes, 0 takes the limit of the cgroup or the physical RAM
+        SubstringsConcurrent(std::size_t minl, std::size_t maxl, unsigned to_skip, unsigned drop_volume, std::size_t amount, unsigned align = 1, std::size_t memory = 0);
         virtual ~SubstringsConcurrent();
-        void process_c(const std::string& path, bool ascii = false, bool filter = true, std::size_t scale = 1);
-        generator_ns::generator<ResultEl> top_c();
+        void process_c(const Segments& input, bool ascii = false, bool filter = true, std::size_t scale = 1, bool wide = false);
+        // counts both inputs into the same table, top_c then ranks by growth from baseline to input
+        void process_diff(const Segments& baseline, const Segments& input, bool ascii = false, bool filter = true, std::size_t scale = 1, bool wide = false);
+        // counts only what was appended to the input since the previous call, returns false if nothing was
+        bool process_more(const Segments& input, bool ascii = false, bool filter = true, std::size_t scale = 1, bool wide = false);
+        void save_checkpoint(const std::string& path, bool ascii, bool filter, bool wide) const;
+        bool load_checkpoint(const std::string& path, bool ascii, bool filter, bool wide);
+        // consume moves the selected keys out of the table, which is left unusable for another top_c
+        generator_ns::generator<ResultEl> top_c(bool relative = false, bool consume = false);
+        // fn gets a provisional top every `every` percent of a pass and whenever one is requested
+        void set_peek(Peek fn, unsigned every);
+        // safe to call from a signal handler
+        static void request_peek() { peek_requested = true; }
+        // the best keys merged so far, callable while a pass is running
+        Result provisional();
+        // runs the passes on a pool shared with other instances instead of an own one
+        void share_executor(std::shared_ptr<tf::Executor> pool);
+        // at most share() slices of a pass run at the same time, asked again before every slice,
+        // an empty one takes the whole pool
+        void set_share(std::function<unsigned()> fn) { share = std::move(fn); }
+        // the passes take their leases from a budget shared with other instances instead of an own one
+        void share_budget(std::shared_ptr<MemoryBudget> budget);
+        // drops the worker counters and buffers kept warm beyond keep bytes
+        void trim(std::size_t keep);
+        // a pinned placement falls back to one worker per logical cpu where the topology is unknown
+        void set_placement(Placement how);
+        bool pinned() const { return !cpus.empty(); }
+        // where progress and diagnostics of the passes go, std::cerr by default
+        void set_log(std::ostream& out) { log = &out; }
+        // forgets the counted keys, so the instance can take an unrelated input
+        void reset();
+        // the keys of a plain run of a flat input also keep the offset of an occurrence
+        void keep_offsets(bool on) { offsets = on; }
+        // keys top_c returns, the table was pruned for the amount of the passes so far
+        void set_amount(std::size_t n) { amount = n; }
+        // the first `amount` candidates not too similar to a better one, candidates ordered best first
+        Result filter_close(Result&& candidates) const;
     protected:
         size_t calc_reserve() const
         {
             return Substrings::calc_reserve(amount);
         }
-        void accumulate(ReducedKeys& rkeys);
-        Estimations tune_on_size(const std::string& path, unsigned pool_size, unsigned scale);
-        void truncate();
-        static auto slice(const Estimations estm, std::size_t maxl)
+        void process_sources(const std::vector<const Segments*>& sources, bool ascii, bool filter, std::size_t scale, bool wide, std::size_t from = 0,
+            bool open_end = false);
+        void count_stream(const Segments& input, unsigned source, std::size_t ino, std::size_t dv, std::size_t overlap, unsigned workers,
+            MemoryBudget& budget, const std::function<void(const Slice&, DataView)>& count);
+        void run_shared(std::size_t count, const std::function<void(std::size_t)>& fn);
+        std::uint64_t checkpoint_tag(bool ascii, bool filter, bool wide) const;
+        template<typename Table>
+        void accumulate(Table& rkeys, std::size_t base, bool to_baseline = false, TopTracker* tracker = nullptr);
+        void use_tallies(bool on);
+        template<typename F>
+        decltype(auto) with_rkeys(F&& fn) { return tallied ? fn(rtallies) : fn(rkeys); }
+        template<typename F>
+        decltype(auto) with_rkeys(F&& fn) const { return tallied ? fn(rtallies) : fn(rkeys); }
+        tf::Executor& get_executor(unsigned pool_size = 0);
+        unsigned pool_limit() const;
+        template<typename Score>
+        void select(Score score, bool consume);
+        Estimations tune_on_size(std::size_t size, unsigned pool_size, unsigned scale);
+        // working memory of a task per KiB of its slice, as assumed before any task has finished
+        std::size_t task_model() const
+        {
+            return 1024u * (1u + (maxl - minl + 1) * (sizeof(WorkEl) * 5 / 4) / (length_step() * align));
+        }
+        std::size_t rkeys_memory() const
+        {
+            const std::size_t key = (minl + maxl) / 2;
+            return with_rkeys([&](const auto& table)
+                { return table.capacity() * (sizeof(*table.begin()) + 1) + table.size() * ((key >= sizeof(Data) / 2) ? key + 1 : 0); });
+        }
+        Extents pad_extents(const Extents& extents, std::size_t lo, std::size_t hi) const;
+        void truncate(bool pressed = false);
+        static void slice(std::vector<Slice>& slices, const Extents& extents, std::size_t dv, std::size_t overlap, unsigned source)
+        {
+            // each slice also takes overlap bytes ahead of its own part for the windows crossing into it
+            for (const auto& [offset, length] : extents)
+            {
+                const std::size_t count = std::max<std::size_t>(length / dv, 1u);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    const std::size_t begin = (i * dv > overlap) ? i * dv - overlap : 0u;
+                    const std::size_t end = (i + 1u < count) ? (i + 1u) * dv : length;
+                    slices.push_back({ slices.size(), source, offset + begin, end - begin, i + 1u == count });
+                }
+            }
+        }
+        static void slice_frames(std::vector<Slice>& slices, const std::vector<Frame>& frames, std::size_t dv, unsigned source)
         {
-            return std::views::iota(static_cast<std::size_t>(0), estm.psize)
-                | std::views::transform(
-                    [=](auto i)
-                    {
-                        return std::pair<std::size_t, std::pair<std::size_t, std::size_t>>{
-                            i,
-                            { (i == 0u) ? i * estm.dv : i * estm.dv - maxl,
-                                (i < estm.psize - 1u) ? ((i == 0u) ? estm.dv : estm.dv + maxl) : estm.dv + maxl + estm.md }
-                        };
-                    });
+            // whole frames up to dv bytes of content, the overlap is read on past the last one of a slice
+            for (std::size_t i = 0; i < frames.size();)
+            {
+                const std::size_t offset = frames[i].content;
+                std::size_t length = 0;
+                do
+                    length += frames[i++].size;
+                while (i < frames.size() && length + frames[i].size <= dv);
+                slices.push_back({ slices.size(), source, offset, length, i == frames.size() });
+            }
         }
     };
 
@@ -0,0 +1,77 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include "TopTracker.hpp"
+
+using namespace std;
+
+TopTracker::TopTracker() : threshold(0), capacity(0), prune_at(0) {}
+
+TopTracker::~TopTracker() {}
+
+void TopTracker::reset(size_t capacity)
+{
+    scoped_lock lock(mtx);
+    members.clear();
+    threshold = 0;
+    this->capacity = capacity;
+    prune_at = capacity * 2;
+}
+
+void TopTracker::offer(string_view key, size_t count, size_t offset)
+{
+    scoped_lock lock(mtx);
+    if (auto it = members.find(key); it != members.end())
+        it->second.first = count;
+    else
+        members.try_emplace(string(key), count, offset);
+    if (members.size() >= prune_at)
+        prune();
+}
+
+void TopTracker::prune()
+{
+    // keeps the capacity largest counts, ties at the boundary stay, and raises the threshold to it
+    vector<size_t> counts;
+    counts.reserve(members.size());
+    for (const auto& [key, entry] : members)
+        counts.push_back(entry.first);
+    nth_element(counts.begin(), counts.begin() + (capacity - 1), counts.end(), greater<>());
+    const size_t bound = counts[capacity - 1];
+    erase_if(members, [=](const auto& i) { return i.second.first < bound; });
+    threshold.store(bound, memory_order_relaxed);
+    // when ties keep the table large, wait for it to double again instead of pruning on every offer
+    prune_at = max(capacity, members.size()) * 2;
+}
+
+vector<pair<string, TopTracker::Entry>> TopTracker::snapshot()
+{
+    vector<pair<string, Entry>> items;
+    {
+        scoped_lock lock(mtx);
+        items.assign(members.begin(), members.end());
+    }
+    sort(items.begin(), items.end(),
+        [](const auto& l, const auto& r) { return (l.second.first == r.second.first) ? l.first > r.first : l.second.first > r.second.first; });
+    return items;
+}
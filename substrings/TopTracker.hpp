@@ -0,0 +1,68 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <functional>
+
+#include <phmap.h>
+
+// Keys that may currently be among the most frequent, kept while the table is being merged so
+// that a provisional answer is available at any time. The merging side checks an offer against
+// the published threshold without taking the lock.
+class TopTracker final
+{
+public:
+    // count and offset of the first occurrence
+    using Entry = std::pair<std::size_t, std::size_t>;
+protected:
+    // looked up by view, a key is copied only when it joins
+    struct KeyHash
+    {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view key) const noexcept { return phmap::Hash<std::string_view>()(key); }
+    };
+
+    std::mutex mtx;
+    phmap::flat_hash_map<std::string, Entry, KeyHash, std::equal_to<>> members;
+    std::atomic<std::size_t> threshold;
+    std::size_t capacity, prune_at;
+public:
+    TopTracker();
+    ~TopTracker();
+    void reset(std::size_t capacity);
+    bool wants(std::size_t count) const
+    {
+        return capacity && count > threshold.load(std::memory_order_relaxed);
+    }
+    void offer(std::string_view key, std::size_t count, std::size_t offset);
+    // members by descending count
+    std::vector<std::pair<std::string, Entry>> snapshot();
+protected:
+    void prune();
+};
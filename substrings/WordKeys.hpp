@@ -0,0 +1,118 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2023 github.com/mrprint
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <string_view>
+
+#include <phmap.h>
+#include "HugePages.hpp"
+
+namespace substrings
+{
+
+    constexpr auto MAX_WORDS = 8u;
+
+    // Windows of whole machine words stored by value, so hashing and comparison work on integers
+    template<typename Word, std::size_t Count>
+    using WordKey = std::array<Word, Count>;
+
+    struct WordKeyHash
+    {
+        template<typename Word, std::size_t Count>
+        std::size_t operator()(const WordKey<Word, Count>& key) const noexcept
+        {
+            std::uint64_t h = Count;
+            for (Word w : key)
+                h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+            return static_cast<std::size_t>(h ^ (h >> 32));
+        }
+    };
+
+    template<typename Word>
+    class WordCounters final
+    {
+    public:
+        static constexpr auto WORD_SIZE = sizeof(Word);
+        static constexpr auto MAX_LENGTH = WORD_SIZE * MAX_WORDS;
+    protected:
+        // count and position of the first occurrence, in 32 bits as the data is limited to 4 GiB
+        using Value = std::pair<std::uint32_t, std::uint32_t>;
+        template<std::size_t Count>
+        using Table = phmap::flat_hash_map<WordKey<Word, Count>, Value, WordKeyHash,
+            phmap::priv::hash_default_eq<WordKey<Word, Count>>, HugePageAllocator<std::pair<const WordKey<Word, Count>, Value>>>;
+
+        template<std::size_t... I>
+        static auto make_tables(std::index_sequence<I...>) -> std::tuple<Table<I + 1>...>;
+
+        decltype(make_tables(std::make_index_sequence<MAX_WORDS>{})) tables;
+    public:
+        void clear()
+        {
+            std::apply([](auto&... t) { (hugepages::keep_clear(t), ...); }, tables);
+        }
+        std::size_t size() const
+        {
+            return std::apply([](const auto&... t) { return (t.size() + ...); }, tables);
+        }
+        // bytes held by the slots, one control byte each
+        std::size_t footprint() const
+        {
+            return std::apply([](const auto&... t) { return ((t.capacity() * (sizeof(*t.begin()) + 1)) + ...); }, tables);
+        }
+        // data must hold count * WORD_SIZE bytes, count <= MAX_WORDS, pos < 4 GiB
+        void add(const char* data, std::size_t count, std::size_t pos)
+        {
+            add_n(data, count, pos, std::make_index_sequence<MAX_WORDS>{});
+        }
+        template<typename F>
+        void for_each(F&& fn) const
+        {
+            std::apply([&](const auto&... t) { (for_each_in(t, fn), ...); }, tables);
+        }
+    protected:
+        template<std::size_t... I>
+        void add_n(const char* data, std::size_t count, std::size_t pos, std::index_sequence<I...>)
+        {
+            static_cast<void>(((count == I + 1 && (insert<I + 1>(data, pos), true)) || ...));
+        }
+        template<std::size_t Count>
+        void insert(const char* data, std::size_t pos)
+        {
+            WordKey<Word, Count> key;
+            std::memcpy(key.data(), data, sizeof(key));
+            std::get<Count - 1>(tables).try_emplace(key, 0u, static_cast<std::uint32_t>(pos)).first->second.first++;
+        }
+        template<typename T, typename F>
+        static void for_each_in(const T& table, F& fn)
+        {
+            for (const auto& [key, value] : table)
+                fn(std::string_view(reinterpret_cast<const char*>(key.data()), sizeof(key)), value.first, value.second);
+        }
+    };
+
+}
@@ -27,45 +27,97 @@
 
 using namespace std;
 
-std::string input_file;
-std::int64_t top;
-std::int64_t lmin, lmax;
-std::int64_t scale;
-unsigned skip, drop;
-bool ascii;
-bool nofilter;
-
-bool handle_args(int argc, char* argv[])
+bool handle_args(int argc, const char* const argv[], Settings& settings, ostream& err)
 {
     cxxopts::Options options("substrings", "The tool designed to find the most frequently occurring sequences in a gigabyte binary file");
     options.add_options()
-        ("input", "Input file", cxxopts::value<string>())
+        ("input", "Input file", cxxopts::value<string>()->default_value(""))
         ("t,top", format("Amount of values to get ( 0 < x < {} )", numeric_limits<unsigned>::max()), cxxopts::value<int64_t>()->default_value("30"))
         ("m,min", format("Minimal length of strings to search ( 6 < x < {} )", numeric_limits<unsigned>::max()), cxxopts::value<int64_t>()->default_value("15"))
         ("x,max", format("Maximal length of strings to search ( min < x < {} )", numeric_limits<unsigned>::max()), cxxopts::value<int64_t>()->default_value("30"))
         ("k,skip", format("Lengths to skip for probing step ( 0 < x < {} )", numeric_limits<unsigned>::max()), cxxopts::value<unsigned>()->default_value("3"))
         ("d,drop", format("Maximal volume of occurences to not accumulate ( 0 <= x < {} )", numeric_limits<unsigned>::max()), cxxopts::value<unsigned>()->default_value("1"))
+        ("n,align", "Scan only offsets aligned to N bytes, probing lengths in whole words (overrides skip)", cxxopts::value<unsigned>()->default_value("1"))
         ("a,ascii", "Search for ascii strings only", cxxopts::value<bool>()->default_value("false"))
+        ("w,wide", "Search for UTF-16LE strings only, lengths are counted in characters", cxxopts::value<bool>()->default_value("false"))
         ("f,nofilter", "Do not prefilter by entropy index", cxxopts::value<bool>()->default_value("false"))
+        ("min-entropy", "Lower bound of the entropy index a string must exceed", cxxopts::value<float>()->default_value(format("{}", substrings::MIN_ENT)))
+        ("max-entropy", "Upper bound of the entropy index a string must stay below", cxxopts::value<float>()->default_value(format("{}", substrings::MAX_ENT)))
+        ("r,raw", "Treat ELF cores and minidumps as flat files", cxxopts::value<bool>()->default_value("false"))
+        ("p,perm", "Scan only segments matching the rwx mask, '.' matches anything (e.g. rw.)", cxxopts::value<string>()->default_value("..."))
+        ("range", "Scan only the part of the input given as OFFSET:LENGTH in bytes", cxxopts::value<string>()->default_value(""))
+        ("b,baseline", "Baseline file to diff the input against, results are ranked by growth", cxxopts::value<string>()->default_value(""))
+        ("g,relative", "Rank the diff by relative growth instead of absolute", cxxopts::value<bool>()->default_value("false"))
+        ("l,follow", "Keep following the growing input, counting appended bytes every N seconds", cxxopts::value<unsigned>()->default_value("0"))
+        ("c,checkpoint", "File to keep the follow state in between runs", cxxopts::value<string>()->default_value(""))
+        ("M,max-memory", "Memory budget in MiB, 0 means the cgroup limit or the physical RAM", cxxopts::value<size_t>()->default_value("0"))
+        ("P,peek", "Print a provisional top to stderr every N percent of the work, SIGUSR1 asks for one at any time", cxxopts::value<unsigned>()->default_value("0"))
+        ("placement", "Workers of a pass: 2x or 1x per logical cpu, or pinned, one per physical core (cores) or per logical cpu (threads); the slices and results are the same under each, the tables are not sized to the caches", cxxopts::value<string>()->default_value("2x"))
+        ("hugepages", "Back the large tables and the chunk buffers with transparent huge pages", cxxopts::value<bool>()->default_value("false"))
+        ("evaluate", "Compare a grid of settings with exact counts on N MiB of the input, or of generated data without one", cxxopts::value<unsigned>()->default_value("0"))
+        ("serve", "Keep running as a server taking jobs on the Unix socket at PATH", cxxopts::value<string>()->default_value(""))
+        ("submit", "Run the command line as a job of the server at PATH", cxxopts::value<string>()->default_value(""))
+        ("bench", "Time the counting loops, then whole passes under each placement, on the head of the input instead; the placements differ in the workers only", cxxopts::value<bool>()->default_value("false"))
         ("s,scale", "Multi-threaded load scaling factor. Using 0 means trying to calculate it heuristically", cxxopts::value<int64_t>()->default_value("0"));
 
-    auto print_desc = [&]() { cerr << options.help() << endl; };
+    auto print_desc = [&]() { err << options.help() << endl; };
 
     try {
         options.parse_positional("input");
         auto result = options.parse(argc, argv);
 
-        input_file = result["input"].as<string>();
-        top = result["top"].as<int64_t>();
-        lmin = result["min"].as<int64_t>();
-        lmax = result["max"].as<int64_t>();
-        skip = result["skip"].as<unsigned>();
-        drop = result["drop"].as<unsigned>();
-        ascii = result["ascii"].as<bool>();
-        nofilter = result["nofilter"].as<bool>();
-        scale = result["scale"].as<int64_t>();
+        settings.input_file = result["input"].as<string>();
+        settings.top = result["top"].as<int64_t>();
+        settings.lmin = result["min"].as<int64_t>();
+        settings.lmax = result["max"].as<int64_t>();
+        settings.skip = result["skip"].as<unsigned>();
+        settings.drop = result["drop"].as<unsigned>();
+        settings.alignment = result["align"].as<unsigned>();
+        settings.ascii = result["ascii"].as<bool>();
+        settings.wide = result["wide"].as<bool>();
+        settings.nofilter = result["nofilter"].as<bool>();
+        settings.scale = result["scale"].as<int64_t>();
+        settings.raw = result["raw"].as<bool>();
+        settings.perms = result["perm"].as<string>();
+        settings.baseline_file = result["baseline"].as<string>();
+        settings.relative = result["relative"].as<bool>();
+        settings.follow = result["follow"].as<unsigned>();
+        settings.checkpoint = result["checkpoint"].as<string>();
+        settings.max_memory = result["max-memory"].as<size_t>() << 20;
+        settings.peek = result["peek"].as<unsigned>();
+        settings.benchmark = result["bench"].as<bool>();
+        settings.hugepages_flag = result["hugepages"].as<bool>();
+        settings.min_entropy = result["min-entropy"].as<float>();
+        settings.max_entropy = result["max-entropy"].as<float>();
+        settings.evaluation = result["evaluate"].as<unsigned>();
+        settings.serve = result["serve"].as<string>();
+        settings.submit = result["submit"].as<string>();
+        const auto placement = result["placement"].as<string>();
+        if (placement == "2x")
+            settings.placement = substrings::Placement::Oversubscribed;
+        else if (placement == "1x")
+            settings.placement = substrings::Placement::Logical;
+        else if (placement == "cores")
+            settings.placement = substrings::Placement::Cores;
+        else if (placement == "threads")
+            settings.placement = substrings::Placement::Threads;
+        else {
+            print_desc();
+            return false;
+        }
+        settings.range_offset = settings.range_length = 0;
+        if (const auto range = result["range"].as<string>(); !range.empty()) {
+            const auto colon = range.find(':');
+            settings.range_offset = stoull(range.substr(0, colon));
+            if (colon != string::npos)
+                settings.range_length = stoull(range.substr(colon + 1));
+        }
 
-        if (input_file.empty() || top < 1 || lmin < 7 || lmax < lmin || skip < 1) {
+        const auto& s = settings;
+        if ((s.input_file.empty() && !s.evaluation && s.serve.empty()) || s.top < 1 || s.lmin < 7 || s.lmax < s.lmin || s.skip < 1
+            || s.alignment < 1 || s.lmax / s.alignment * s.alignment < s.lmin || (s.wide && s.alignment > 1)
+            || !Segments::valid_mask(s.perms) || (s.follow && (!s.baseline_file.empty() || s.range_offset || s.range_length)) || s.peek > 100
+            || s.min_entropy < 0.0f || s.min_entropy >= s.max_entropy || (!s.serve.empty() && !s.submit.empty())) {
             print_desc();
             return false;
         }
@@ -74,6 +126,10 @@ bool handle_args(int argc, char* argv[])
         print_desc();
         return false;
     }
+    catch (const logic_error&) { // a malformed range
+        print_desc();
+        return false;
+    }
     return true;
 }
 
@@ -85,17 +141,17 @@ void ProgressIndicator::display(Phase phase)
     if (phase == Phase::Work) {
         if (!updated)
             return;
-        cerr << "\b\b\b\b";
-        cerr << setfill(' ') << setw(3) << percent << '%';
-        cerr.flush();
+        out << "\b\b\b\b";
+        out << setfill(' ') << setw(3) << percent << '%';
+        out.flush();
         updated = false;
     }
     else if (phase == Phase::Begin) {
-        cerr << "  0%";
-        cerr.flush();
+        out << "  0%";
+        out.flush();
     }
     else if (phase == Phase::End) {
-        cerr << "\b\b\b\b100%" << endl;
+        out << "\b\b\b\b100%" << endl;
         updated = false;
     }
 }
\ No newline at end of file
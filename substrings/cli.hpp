@@ -24,20 +24,44 @@
 
 #include <string>
 #include <mutex>
+#include <iostream>
 #include "Substrings.hpp"
 
-extern std::string input_file;
-extern std::int64_t top;
-extern std::int64_t lmin, lmax;
-extern std::int64_t scale;
-extern unsigned skip, drop;
-extern bool ascii;
-extern bool nofilter;
+// Everything a run is asked for on the command line, so that a server can hold one per job
+struct Settings
+{
+    std::string input_file;
+    std::int64_t top;
+    std::int64_t lmin, lmax;
+    std::int64_t scale;
+    unsigned skip, drop;
+    unsigned alignment;
+    bool ascii;
+    bool wide;
+    bool nofilter;
+    bool raw;
+    std::string perms;
+    std::size_t range_offset, range_length;
+    std::string baseline_file;
+    bool relative;
+    unsigned follow;
+    std::string checkpoint;
+    std::size_t max_memory;
+    unsigned peek;
+    bool benchmark;
+    bool hugepages_flag;
+    float min_entropy, max_entropy;
+    substrings::Placement placement;
+    unsigned evaluation;
+    std::string serve, submit;
+};
 
-bool handle_args(int argc, char* argv[]);
+// fills settings from the command line, prints the usage to err and returns false if it is not valid
+bool handle_args(int argc, const char* const argv[], Settings& settings, std::ostream& err = std::cerr);
 
 class ProgressIndicator {
     std::mutex mtx;
+    std::ostream& out;
     std::size_t total, progress, percent;
     bool updated;
 
@@ -50,7 +74,7 @@ public:
     };
 
     ProgressIndicator() = delete;
-    explicit ProgressIndicator(std::size_t total) : total(total), progress(0), percent(0), updated(false) {};
+    explicit ProgressIndicator(std::size_t total, std::ostream& out = std::cerr) : out(out), total(total), progress(0), percent(0), updated(false) {};
     void update(std::size_t val)
     {
         std::scoped_lock lock(mtx);
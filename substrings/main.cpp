@@ -24,15 +24,113 @@
 #include <fstream>
 #include <filesystem>
 #include <clocale>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <iomanip>
+#include <limits>
 // #include <format>
 #include <absl/strings/escaping.h>
 #include "Substrings.hpp"
+#include "Evaluation.hpp"
+#include "Server.hpp"
 #include "cli.hpp"
 #include "timeit.hpp"
 
 using namespace std;
 using namespace substrings;
 
+static void bench(const Settings& settings)
+{
+    // times process() on the head of the input with the specialized kernel and with the generic loop
+    constexpr size_t BENCH_BYTES = size_t(64) << 20;
+    constexpr int BENCH_RUNS = 3;
+    const auto& path = settings.input_file;
+    string data(min<size_t>(filesystem::file_size(path), BENCH_BYTES), '\0');
+    ifstream(path, ios::in | ios::binary).read(data.data(), data.size());
+    Substrings subs(settings.lmin, settings.lmax, settings.skip, settings.alignment);
+    subs.set_entropy(settings.min_entropy, settings.max_entropy);
+    const bool has_kernel = subs.has_kernel();
+    if (!has_kernel)
+        cerr << "No specialized kernel for these lengths, timing the generic loop only" << endl;
+    for (bool on : { false, true })
+    {
+        if (on && !has_kernel)
+            break;
+        subs.use_kernels(on);
+        double best = numeric_limits<double>::max();
+        for (int run = 0; run < BENCH_RUNS; ++run)
+        {
+            const auto start = chrono::steady_clock::now();
+            subs.process(data, settings.ascii, !settings.nofilter, settings.wide);
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        cout << (on ? "specialized" : "generic") << " \t" << fixed << setprecision(1)
+            << data.size() / best / (1 << 20) << " MiB/s \t" << subs.size() << " keys\n";
+    }
+    // then whole passes over the same bytes with every placement of the workers
+    Segments input;
+    input.assign(data);
+    ostream quiet(nullptr);
+    for (auto [name, how] : { pair("2x", Placement::Oversubscribed), pair("1x", Placement::Logical), pair("cores", Placement::Cores), pair("threads", Placement::Threads) })
+    {
+        SubstringsConcurrent pass(settings.lmin, settings.lmax, settings.skip, settings.drop, settings.top, settings.alignment, settings.max_memory);
+        pass.set_entropy(settings.min_entropy, settings.max_entropy);
+        pass.set_log(quiet);
+        pass.set_placement(how);
+        if ((how == Placement::Cores || how == Placement::Threads) && !pass.pinned()) {
+            cout << name << " \tno cpu topology to pin to\n";
+            continue;
+        }
+        double best = numeric_limits<double>::max();
+        for (int run = 0; run < BENCH_RUNS; ++run)
+        {
+            pass.reset();
+            const auto start = chrono::steady_clock::now();
+            pass.process_c(input, settings.ascii, !settings.nofilter, settings.scale, settings.wide);
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        cout << name << " \t" << fixed << setprecision(1) << data.size() / best / (1 << 20) << " MiB/s\n";
+    }
+}
+
+static void print_to(ostream& out, const Settings& settings, const Segments& input, auto&& results)
+{
+    for (auto&& [key, value] : results)
+    {
+        out << value.count << " \t";
+        if (!settings.baseline_file.empty())
+            out << value.baseline << " \t";
+        if (input.mapped())
+            out << "0x" << hex << input.address(value.offset) << dec << " \t";
+        out << absl::CHexEscape(key) << '\n';
+        // cout << value << " \t" << format("[{:?}]", key) << '\n'; // requires c++23
+    }
+    out.flush();
+}
+
+static void analyze(const Settings& settings, SubstringsConcurrent& subs, ostream& out, ostream& err)
+{
+    // one count or diff of the input, as run from the command line or as a job of the server
+    Segments input, reference;
+    subs.set_entropy(settings.min_entropy, settings.max_entropy);
+    subs.set_log(err);
+    subs.set_peek([&](const Result& results) { err << "\n--- provisional\n"; print_to(err, settings, input, results); }, settings.peek);
+    input.load(settings.input_file, settings.raw);
+    input.filter(settings.perms);
+    input.clip(settings.range_offset, settings.range_length);
+    if (settings.baseline_file.empty())
+        subs.process_c(input, settings.ascii, !settings.nofilter, settings.scale, settings.wide);
+    else {
+        reference.load(settings.baseline_file, settings.raw);
+        reference.filter(settings.perms);
+        reference.clip(settings.range_offset, settings.range_length);
+        subs.process_diff(reference, input, settings.ascii, !settings.nofilter, settings.scale, settings.wide);
+    }
+    print_to(out, settings, input, subs.top_c(settings.relative, true));
+    subs.set_peek(nullptr, 0);
+}
+
 int main(int argc, char* argv[])
 {
     TimeIt time_it("Total time is");
@@ -41,22 +139,68 @@ int main(int argc, char* argv[])
     setlocale(LC_ALL, "");
 
     try {
-        if (!handle_args(argc, argv))
+        Settings settings;
+        if (!handle_args(argc, argv, settings))
             return 1;
 
-        SubstringsConcurrent subs(lmin, lmax, skip, drop, top);
+        if (!settings.submit.empty())
+            return submit(settings.submit, argc, argv);
+        hugepages::enable(settings.hugepages_flag);
+        if (settings.benchmark) {
+            bench(settings);
+            return 0;
+        }
+        if (settings.evaluation) {
+            evaluate(settings, size_t(settings.evaluation) << 20);
+            return 0;
+        }
+#if defined(SIGUSR1)
+        signal(SIGUSR1, [](int) { SubstringsConcurrent::request_peek(); });
+#endif
+        if (!settings.serve.empty()) {
+            Server server(settings.serve, analyze, settings.max_memory);
+            server.run();
+            return 0;
+        }
+        SubstringsConcurrent subs(settings.lmin, settings.lmax, settings.skip, settings.drop, settings.top, settings.alignment, settings.max_memory);
+        subs.set_entropy(settings.min_entropy, settings.max_entropy);
+        subs.set_placement(settings.placement);
+        if ((settings.placement == Placement::Cores || settings.placement == Placement::Threads) && !subs.pinned())
+            cerr << "No cpu topology to pin the workers to, running one per logical cpu" << endl;
 #if !defined(_DEBUG) && !defined(DEBUG)
-        subs.process_c(input_file, ascii, !nofilter, scale);
-        for (auto&& [key, value] : subs.top_c())
-        {
-            cout << value << " \t" << absl::CHexEscape(key) << '\n';
-            // cout << value << " \t" << format("[{:?}]", key) << '\n'; // requires c++23
+        if (settings.follow) {
+            // a growing file is read as a flat blob, each round counts only the bytes appended since the last one
+            const bool filter = !settings.nofilter;
+            Segments input;
+            subs.set_peek([&](const Result& results) { cerr << "\n--- provisional\n"; print_to(cerr, settings, input, results); }, settings.peek);
+            if (!settings.checkpoint.empty() && subs.load_checkpoint(settings.checkpoint, settings.ascii, filter, settings.wide))
+                cerr << "Resumed from " << settings.checkpoint << endl;
+            Result shown;
+            for (;;)
+            {
+                input.load(settings.input_file, true);
+                if (subs.process_more(input, settings.ascii, filter, settings.scale, settings.wide)) {
+                    if (!settings.checkpoint.empty())
+                        subs.save_checkpoint(settings.checkpoint, settings.ascii, filter, settings.wide);
+                    Result current;
+                    for (auto&& i : subs.top_c())
+                        current.push_back(i);
+                    auto same = [](const auto& l, const auto& r) { return l.first == r.first && l.second.count == r.second.count; };
+                    if (!ranges::equal(current, shown, same)) {
+                        cout << "--- " << input.file_size() << " bytes\n";
+                        print_to(cout, settings, input, current);
+                        shown.swap(current);
+                    }
+                }
+                this_thread::sleep_for(chrono::seconds(settings.follow));
+            }
         }
+        analyze(settings, subs, cout, cerr);
 #else
-        subs.process_file(input_file);
-        for (auto&& [key, value] : subs.top(top))
+        subs.process_file(settings.input_file);
+        for (auto&& [key, value] : subs.top(settings.top))
         {
-            cout << value << " \t" << absl::CHexEscape(key) << '\n';
+            cout << value.count << " \t" << absl::CHexEscape(key) << '\n';
             // cout << value << " \t" << format("[{:?}]", key) << '\n'; // requires c++23
         }
 #endif
@@ -70,5 +214,3 @@ int main(int argc, char* argv[])
     }
     return 0;
 }
-
-
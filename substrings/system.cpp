@@ -22,10 +22,20 @@
 
 #if defined(_MSC_BUILD) || defined(__MINGW32__)
 #include <windows.h>
+#include <psapi.h>
 #else
 #include <sys/sysinfo.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
 #endif
 
+#include <algorithm>
+#include <fstream>
+
 #include "system.hpp"
 
 using namespace std;
@@ -40,6 +50,34 @@ size_t get_ram_size()
     return statex.ullTotalPhys;
 }
 
+size_t get_memory_limit()
+{
+    return get_ram_size();
+}
+
+size_t get_peak_rss()
+{
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+}
+
+vector<FileExtent> get_data_extents(const string& path, size_t size)
+{
+    return { { 0, size } };
+}
+
+vector<CpuInfo> get_cpu_topology()
+{
+    return {};
+}
+
+bool pin_thread(unsigned cpu)
+{
+    return cpu < 64 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+}
+
 #else
 
 size_t get_ram_size()
@@ -50,4 +88,97 @@ size_t get_ram_size()
     return 0;
 }
 
-#endif
\ No newline at end of file
+size_t get_memory_limit()
+{
+    size_t limit = get_ram_size();
+    string line, group;
+    ifstream cgroup("/proc/self/cgroup");
+    while (getline(cgroup, line))
+    {
+        if (line.starts_with("0::")) // the unified hierarchy
+            group = line.substr(3);
+    }
+    if (group.empty())
+        return limit;
+    // every level up to the root of the namespace may hold a limit, a container's usually sits at the root
+    for (;;)
+    {
+        ifstream f("/sys/fs/cgroup" + ((group == "/") ? string() : group) + "/memory.max");
+        string value;
+        if (f >> value && value != "max") {
+            const size_t bytes = stoull(value);
+            limit = limit ? min(limit, bytes) : bytes;
+        }
+        if (group.empty() || group == "/")
+            break;
+        const size_t slash = group.rfind('/');
+        group.resize((slash == string::npos) ? 0 : max<size_t>(slash, 1));
+    }
+    return limit;
+}
+
+size_t get_peak_rss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return static_cast<size_t>(usage.ru_maxrss) * 1024u;
+    return 0;
+}
+
+vector<FileExtent> get_data_extents(const string& path, size_t size)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        vector<FileExtent> extents;
+        off_t pos = 0;
+        while (static_cast<size_t>(pos) < size) {
+            off_t data = lseek(fd, pos, SEEK_DATA);
+            if (data < 0) {
+                if (errno != ENXIO) // not supported here, treat the whole file as data
+                    extents.assign(1, { 0, size });
+                break;
+            }
+            off_t hole = lseek(fd, data, SEEK_HOLE);
+            size_t end = (hole < 0) ? size : min(static_cast<size_t>(hole), size);
+            if (static_cast<size_t>(data) >= end)
+                break;
+            extents.push_back({ static_cast<size_t>(data), end - static_cast<size_t>(data) });
+            pos = static_cast<off_t>(end);
+        }
+        close(fd);
+        return extents;
+    }
+#endif
+    return { { 0, size } };
+}
+
+vector<CpuInfo> get_cpu_topology()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return {};
+    vector<CpuInfo> cpus;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        const string dir = "/sys/devices/system/cpu/cpu" + to_string(cpu);
+        CpuInfo info{ cpu, 0, 0 };
+        if (!(ifstream(dir + "/topology/core_id") >> info.core) || !(ifstream(dir + "/topology/physical_package_id") >> info.package))
+            return {};
+        cpus.push_back(info);
+    }
+    return cpus;
+}
+
+bool pin_thread(unsigned cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#endif
@@ -23,5 +23,26 @@
 #pragma once
 
 #include <string>
+#include <vector>
+
+struct FileExtent
+{
+    std::size_t offset, length;
+};
+
+// A logical cpu and the physical core and package it belongs to
+struct CpuInfo
+{
+    unsigned cpu, core, package;
+};
 
 std::size_t get_ram_size();
+// Memory the process may use: the physical RAM, lowered to the cgroup v2 memory.max limits on the way to the root
+std::size_t get_memory_limit();
+std::size_t get_peak_rss();
+// Regions of the file holding data; sparse holes are left out where the platform reports them
+std::vector<FileExtent> get_data_extents(const std::string& path, std::size_t size);
+// The logical cpus the process may run on, from sysfs; empty where the platform doesn't tell
+std::vector<CpuInfo> get_cpu_topology();
+// binds the calling thread to a logical cpu, false if that was refused
+bool pin_thread(unsigned cpu);